@@ -0,0 +1,301 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <kuramoto.h>
+#include <integrator.h>
+#include <mappedFile.h>
+#include <jThread/jThread.h>
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+
+#ifndef WINDOWS
+#include <unistd.h>
+#endif
+
+/*
+    Binary checkpoint of a run.
+
+    A fixed header (magic, version, parameters, sizes), then the arrays
+    each starting on a 64 byte boundary
+
+        coefficients, shifts   float[harmonics]
+        theta, omega           float[n]
+        counts                 int32[n]
+        offsets                uint64[n+1]   \
+        indices                int32[edges]   | only when the graph is stored
+        weights                float[edges]  /
+
+    in native byte order. The section offsets follow from the header
+    alone, so a reader maps the file and points straight at them.
+
+    The noise is counter based, so (seed, step) is the whole RNG state.
+    Graphs that are a function of the seed (implicit, mean-field, fft)
+    are not stored.
+*/
+
+const char CHECKPOINT_MAGIC[8] = {'K', 'U', 'R', 'A', 'C', 'K', 'P', 'T'};
+const uint32_t CHECKPOINT_VERSION = 3;
+
+struct CheckpointHeader
+{
+    char magic[8];
+    uint32_t version = CHECKPOINT_VERSION;
+    uint32_t harmonics = 0;
+    char engine[16] = {0};
+    // -stencil of the fft and convolution engines, since version 2
+    char stencil[16] = {0};
+    int32_t cells = 0;
+    int32_t shells = 0;
+    float k = 0.0;
+    float o = 0.0;
+    float kd = 0.0;
+    float eta = 0.0;
+    float kp = 0.0;
+    // Sampler of a graph rebuilt from the seed, 0 (box) in older files
+    uint32_t sampler = 0;
+    // Scheme, KernelMode and -phase, since version 3
+    uint32_t scheme = 0;
+    uint32_t kernel = 0;
+    char phase[16] = {0};
+    double dt = 0.0;
+    uint64_t seed = 0;
+    // steps taken, the noise counter to resume from
+    uint64_t step = 0;
+    uint64_t n = 0;
+    // 0 when no graph is stored
+    uint64_t edges = 0;
+    uint64_t graph = 0;
+};
+
+struct Checkpoint
+{
+    CheckpointHeader header;
+    std::vector<float> coefficients;
+    std::vector<float> shifts;
+    std::vector<float> theta;
+    std::vector<float> omega;
+    std::vector<int> counts;
+};
+
+// byte offsets of each section and the file size
+struct CheckpointLayout
+{
+    CheckpointLayout(const CheckpointHeader & h)
+    {
+        uint64_t at = sizeof(CheckpointHeader);
+        auto next = [&at](uint64_t bytes)
+        {
+            at = (at+63)/64*64;
+            uint64_t offset = at;
+            at += bytes;
+            return offset;
+        };
+        coefficients = next(h.harmonics*sizeof(float));
+        shifts = next(h.harmonics*sizeof(float));
+        theta = next(h.n*sizeof(float));
+        omega = next(h.n*sizeof(float));
+        counts = next(h.n*sizeof(int32_t));
+        offsets = next(h.graph ? (h.n+1)*sizeof(uint64_t) : 0);
+        indices = next(h.edges*sizeof(int32_t));
+        weights = next(h.edges*sizeof(float));
+        size = at;
+    }
+
+    uint64_t coefficients, shifts, theta, omega, counts, offsets, indices, weights, size;
+};
+
+/*
+    Write to path+".tmp" and rename over path, so a crash mid write
+    leaves the last complete checkpoint. K may be null (no graph).
+*/
+void writeCheckpoint(const std::string & path, const Checkpoint & state, const Coupling * K)
+{
+    CheckpointHeader h = state.header;
+    std::memcpy(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic));
+    h.version = CHECKPOINT_VERSION;
+    h.harmonics = state.coefficients.size();
+    h.n = state.theta.size();
+    h.graph = K != nullptr;
+    h.edges = K ? K->edges() : 0;
+    const CheckpointLayout layout(h);
+
+    const std::string tmp = path+".tmp";
+    FILE * file = std::fopen(tmp.c_str(), "wb");
+    if (file == nullptr)
+    {
+        throw std::runtime_error("Could not open checkpoint "+tmp);
+    }
+
+    SectionWriter writer(file);
+
+    writer.section(0, &h, sizeof(h));
+    writer.section(layout.coefficients, state.coefficients.data(), h.harmonics*sizeof(float));
+    writer.section(layout.shifts, state.shifts.data(), h.harmonics*sizeof(float));
+    writer.section(layout.theta, state.theta.data(), h.n*sizeof(float));
+    writer.section(layout.omega, state.omega.data(), h.n*sizeof(float));
+    writer.section(layout.counts, state.counts.data(), h.n*sizeof(int32_t));
+    if (K)
+    {
+        writer.section(layout.offsets, K->offsets.data(), (h.n+1)*sizeof(uint64_t));
+        writer.section(layout.indices, K->indices.data(), h.edges*sizeof(int32_t));
+        writer.section(layout.weights, K->weights.data(), h.edges*sizeof(float));
+    }
+    writer.section(layout.size, nullptr, 0);
+
+    bool ok = std::fflush(file) == 0 && writer.ok();
+#ifndef WINDOWS
+    ok = fsync(fileno(file)) == 0 && ok;
+#endif
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok)
+    {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Could not write checkpoint "+tmp);
+    }
+
+#ifdef WINDOWS
+    // rename does not replace on windows
+    std::remove(path.c_str());
+#endif
+    if (std::rename(tmp.c_str(), path.c_str()) != 0)
+    {
+        throw std::runtime_error("Could not rename checkpoint "+tmp+" to "+path);
+    }
+}
+
+/*
+    Map path and copy it into state and K (left empty if no graph was
+    stored). Throws on a bad magic, version or size, if n is not cells
+    squared, if a count is below one (the integrator divides by it) or if
+    a stored graph is not Coupling::valid.
+*/
+void readCheckpoint(const std::string & path, Checkpoint & state, Coupling & K)
+{
+    const MappedFile file(path);
+    if (file.size() < sizeof(CheckpointHeader))
+    {
+        throw std::runtime_error("Checkpoint "+path+" is truncated");
+    }
+
+    CheckpointHeader h;
+    std::memcpy(&h, file.data(), sizeof(h));
+    if (std::memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic)) != 0)
+    {
+        throw std::runtime_error(path+" is not a checkpoint");
+    }
+    if (h.version != CHECKPOINT_VERSION)
+    {
+        throw std::runtime_error
+        (
+            "Checkpoint "+path+" is version "+std::to_string(h.version)+
+            ", expected "+std::to_string(CHECKPOINT_VERSION)
+        );
+    }
+    h.engine[sizeof(h.engine)-1] = '\0';
+    h.stencil[sizeof(h.stencil)-1] = '\0';
+    h.phase[sizeof(h.phase)-1] = '\0';
+    if (h.scheme > uint32_t(Scheme::RK4) || h.kernel > uint32_t(KernelMode::PHASOR))
+    {
+        throw std::runtime_error("Checkpoint "+path+" has an unknown integrator or kernel");
+    }
+    if (h.cells <= 0 || h.n != uint64_t(h.cells)*uint64_t(h.cells))
+    {
+        throw std::runtime_error
+        (
+            "Checkpoint "+path+" has "+std::to_string(h.n)+" oscillators for "+
+            std::to_string(h.cells)+" cells"
+        );
+    }
+    const CheckpointLayout layout(h);
+    if (layout.size != file.size())
+    {
+        throw std::runtime_error("Checkpoint "+path+" has the wrong size");
+    }
+
+    state.header = h;
+    file.copy(state.coefficients, layout.coefficients, h.harmonics);
+    file.copy(state.shifts, layout.shifts, h.harmonics);
+    file.copy(state.theta, layout.theta, h.n);
+    file.copy(state.omega, layout.omega, h.n);
+    file.copy(state.counts, layout.counts, h.n);
+    if (std::any_of(state.counts.begin(), state.counts.end(), [](int c) { return c < 1; }))
+    {
+        throw std::runtime_error("Checkpoint "+path+" has a count below one");
+    }
+    K.clear();
+    if (h.graph)
+    {
+        file.copy(K.offsets, layout.offsets, h.n+1);
+        file.copy(K.indices, layout.indices, h.edges);
+        file.copy(K.weights, layout.weights, h.edges);
+
+        if (!K.valid(h.n))
+        {
+            K.clear();
+            throw std::runtime_error("Checkpoint "+path+" has a corrupt graph");
+        }
+    }
+}
+
+/*
+    Writes checkpoints on a thread of its own. The state is taken by
+    value (a copy of O(N) arrays), K is only read and must not change
+    until the write is done, as the graph never does after it is built.
+*/
+class CheckpointWriter
+{
+
+public:
+
+    CheckpointWriter(std::string path)
+    : path(path), worker(1)
+    {}
+
+    ~CheckpointWriter()
+    {
+        worker.wait();
+    }
+
+    // false (and nothing written) if the last write is still going
+    bool save(Checkpoint state, const Coupling * K)
+    {
+        if (worker.busy())
+        {
+            return false;
+        }
+        pending = std::move(state);
+        worker.queueJob
+        (
+            [this, K]()
+            {
+                try
+                {
+                    writeCheckpoint(path, pending, K);
+                }
+                catch (const std::exception & e)
+                {
+                    std::cerr << e.what() << "\n";
+                }
+            }
+        );
+        return true;
+    }
+
+    void wait() { worker.wait(); }
+
+private:
+
+    std::string path;
+    Checkpoint pending;
+    // declared last so it is joined before pending goes
+    jThread::ThreadPool worker;
+};
+
+#endif /* CHECKPOINT_H */
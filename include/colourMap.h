@@ -0,0 +1,25 @@
+#ifndef COLOURMAP_H
+#define COLOURMAP_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+
+float clamp(float x, float low, float high)
+{
+    return std::min(std::max(x, low), high);
+}
+
+float poly(float x, float p0, float p1, float p2, float p3, float p4)
+{
+   float x2 = x*x; float x4 = x2*x2; float x3 = x2*x;
+   return clamp(p0+p1*x+p2*x2+p3*x3+p4*x4,0.0,1.0);
+}
+
+// t in [0, 1] to rgb, matches cmap in the Visualise shader
+glm::vec3 cmap(float t)
+{
+    return glm::vec3( poly(t,0.91, 3.74, -32.33, 57.57, -28.99), poly(t,0.2, 5.6, -18.89, 25.55, -12.25), poly(t,0.22, -4.89, 22.31, -23.58, 5.97) );
+}
+
+#endif /* COLOURMAP_H */
@@ -0,0 +1,221 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+#include <engine.h>
+#include <parallel.h>
+#include <fft.h>
+
+#include <vector>
+#include <complex>
+#include <functional>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <cmath>
+
+/*
+    Translation invariant coupling on the cells x cells torus.
+
+    weight(dx, dy) is the coupling from oscillator (x, y) to (x+dx, y+dy)
+    for |dx|, |dy| <= radius. neighbours is the normalisation the caller
+    should use for every oscillator, it matches the graph engine and the
+    shader (1 + the expected number of neighbours).
+*/
+struct Stencil
+{
+    int radius = 0;
+    std::function<double(int, int)> weight;
+    double neighbours = 1.0;
+};
+
+// uniform k over the (2s+1)^2 box, the coreShell block of the shader
+Stencil boxStencil(int s, double k)
+{
+    Stencil st;
+    st.radius = s;
+    st.weight = [k](int, int) { return k; };
+    st.neighbours = 1.0+double((2*s+1)*(2*s+1));
+    return st;
+}
+
+// uniform k over the disc dx^2+dy^2 <= r^2
+Stencil discStencil(int r, double k)
+{
+    Stencil st;
+    st.radius = r;
+    st.weight = [k, r](int dx, int dy) { return dx*dx+dy*dy <= r*r ? k : 0.0; };
+    st.neighbours = 1.0;
+    for (int dx = -r; dx <= r; dx++)
+    {
+        for (int dy = -r; dy <= r; dy++)
+        {
+            if (dx*dx+dy*dy <= r*r) { st.neighbours += 1.0; }
+        }
+    }
+    return st;
+}
+
+/*
+    The expectation of the random graph engine's coupling: an edge at
+    squared distance d is kept with probability min(1, kp/(kd d)) and has
+    weight k U(0,1), so mean weight k/2.
+*/
+Stencil powerLawStencil(int s, double k, double kp, double kd)
+{
+    auto p = [kp, kd](int dx, int dy)
+    {
+        double d = double(dx*dx+dy*dy);
+        return d == 0.0 ? 1.0 : std::min(1.0, kp/(kd*d));
+    };
+    Stencil st;
+    st.radius = s;
+    st.weight = [k, p](int dx, int dy) { return 0.5*k*p(dx, dy); };
+    st.neighbours = 1.0;
+    for (int dx = -s; dx <= s; dx++)
+    {
+        for (int dy = -s; dy <= s; dy++)
+        {
+            st.neighbours += p(dx, dy);
+        }
+    }
+    return st;
+}
+
+Stencil stencilFromString(std::string type, int s, double k, double kp, double kd)
+{
+    if (type == "box") { return boxStencil(s, k); }
+    if (type == "disc") { return discStencil(s, k); }
+    if (type == "powerlaw") { return powerLawStencil(s, k, kp, kd); }
+    throw std::runtime_error("Unknown stencil: "+type);
+}
+
+/*
+    Coupling as a periodic convolution, computed with FFTs.
+
+    sum_j W(j-i) kernel(theta_j-theta_i)
+        = sum_n c_n Im( e^{i(s_n - n theta_i)} (W (*) e^{i n theta})_i )
+
+    so each harmonic costs one forward and one inverse 2D FFT of the
+    field, O(N log N) whatever the stencil radius. cells must be a power
+    of 2.
+*/
+struct Convolution : public Engine
+{
+    Convolution(uint64_t cells = 1)
+    : cells(cells), fft(cells), field(cells*cells), spectrum(cells*cells)
+    {}
+
+    uint64_t cells;
+    std::vector<float> expansion_coefficients = {1.0};
+    std::vector<float> shifts = {0.0};
+
+    std::vector<uint64_t> partition(unsigned count) const { return evenBlocks(size(), count); }
+
+    uint64_t size() const { return cells*cells; }
+
+    // the equivalent stencil graph, non zero weights per oscillator
+    uint64_t edges() const { return support*size(); }
+
+    void setStencil(const Stencil & stencil, jThread::ThreadPool * pool = nullptr)
+    {
+        const int64_t n = cells;
+        std::fill(spectrum.begin(), spectrum.end(), std::complex<double>(0.0, 0.0));
+        support = 0;
+        // (W (*) f)_i = sum_d w[d] f[i-d] = sum_j w[i-j] f_j, so w[d] = W(-d)
+        for (int dy = -stencil.radius; dy <= stencil.radius; dy++)
+        {
+            for (int dx = -stencil.radius; dx <= stencil.radius; dx++)
+            {
+                int64_t x = ((-dx)%n+n)%n;
+                int64_t y = ((-dy)%n+n)%n;
+                const double w = stencil.weight(dx, dy);
+                spectrum[y*n+x] += w;
+                if (w != 0.0) { support++; }
+            }
+        }
+        fft.forward(spectrum, pool, evenBlocks(cells, 1));
+        neighbours = stencil.neighbours;
+    }
+
+    void interaction
+    (
+        const std::vector<float> & theta,
+        std::vector<float> & dtheta,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & blocks
+    )
+    {
+        const std::vector<uint64_t> rows = evenBlocks(cells, blocks.size()-1);
+
+        for (uint64_t m = 0; m < expansion_coefficients.size(); m++)
+        {
+            const double harmonic = double(m+1);
+
+            parallelFor
+            (
+                pool,
+                rows,
+                [&](uint64_t begin, uint64_t end)
+                {
+                    for (uint64_t j = begin*cells; j < end*cells; j++)
+                    {
+                        double a = harmonic*theta[j];
+                        field[j] = std::complex<double>(std::cos(a), std::sin(a));
+                    }
+                }
+            );
+
+            fft.forward(field, pool, rows);
+
+            parallelFor
+            (
+                pool,
+                rows,
+                [&](uint64_t begin, uint64_t end)
+                {
+                    for (uint64_t j = begin*cells; j < end*cells; j++)
+                    {
+                        const std::complex<double> f = field[j];
+                        const std::complex<double> w = spectrum[j];
+                        field[j] = std::complex<double>
+                        (
+                            f.real()*w.real()-f.imag()*w.imag(),
+                            f.real()*w.imag()+f.imag()*w.real()
+                        );
+                    }
+                }
+            );
+
+            fft.inverse(field, pool, rows);
+
+            const double c = expansion_coefficients[m];
+            const double s = shifts[m];
+            parallelFor
+            (
+                pool,
+                rows,
+                [&](uint64_t begin, uint64_t end)
+                {
+                    for (uint64_t i = begin*cells; i < end*cells; i++)
+                    {
+                        // Im( e^{i a} F ) = sin(a) Re F + cos(a) Im F
+                        double a = s-harmonic*theta[i];
+                        dtheta[i] += c*(std::sin(a)*field[i].real()+std::cos(a)*field[i].imag());
+                    }
+                }
+            );
+        }
+    }
+
+    double neighbours = 1.0;
+
+private:
+
+    uint64_t support = 0;
+
+    FFT2D fft;
+    std::vector<std::complex<double>> field;
+    std::vector<std::complex<double>> spectrum;
+};
+
+#endif /* CONVOLUTION_H */
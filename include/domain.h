@@ -0,0 +1,215 @@
+#ifndef DOMAIN_H
+#define DOMAIN_H
+
+#include <engine.h>
+#include <kuramoto.h>
+#include <graph.h>
+#include <parallel.h>
+#include <transport.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+// first row of each rank's strip of the cells x cells torus, and cells
+std::vector<uint64_t> stripRows(int cells, int ranks)
+{
+    return evenBlocks(cells, ranks);
+}
+
+/*
+    The stored graph engine for one strip of rows of the torus, the
+    rest of the lattice lives on the other ranks of the transport.
+
+    theta, dtheta (and so the integrator's buffers, omega, counts and
+    noise) hold only the strip's rows, oscillator r here is global
+    oscillator begin()+r. Every evaluation copies theta into a buffer
+    with shells rows of halo either side, swaps halos with the ranks
+    above and below, then runs a Kuramoto engine whose rows index that
+    buffer. Rows are stored in the order buildGraph stores them, so a
+    run over any number of ranks matches the single process one.
+
+    Every rank needs at least shells rows, its halo comes from one
+    neighbour.
+*/
+class DomainKuramoto : public Engine
+{
+
+public:
+
+    DomainKuramoto
+    (
+        const HashedGraph & graph,
+        Transport & transport,
+        std::vector<int> & counts,
+        jThread::ThreadPool * pool,
+        unsigned threads
+    )
+    : transport(transport), cells(graph.cells), halo(graph.shells)
+    {
+        check(cells, halo, transport.size());
+        const std::vector<uint64_t> strips = stripRows(cells, transport.size());
+        y0 = strips[transport.rank()];
+        rows = strips[transport.rank()+1]-y0;
+
+        // neighbour j of i at row offset dy (periodic) lands dy rows from i in the buffer
+        const uint64_t c = cells;
+        auto column = [this, c](uint64_t i, int j)
+        {
+            int64_t dy = int64_t(j/c)-int64_t(i/c);
+            dy %= int64_t(c);
+            if (dy < 0) { dy += c; }
+            if (dy >= 0.5*c) { dy -= c; }
+            const int64_t row = int64_t(i/c-y0)+halo+dy;
+            return int(row*c+j%c);
+        };
+
+        Coupling strip;
+        buildRows(strip, counts, graph, begin(), size(), column, pool, evenBlocks(size(), threads));
+
+        // empty rows for the halos
+        const uint64_t pad = halo*c;
+        Coupling & K = local.K;
+        K.offsets.assign(pad, 0);
+        K.offsets.insert(K.offsets.end(), strip.offsets.begin(), strip.offsets.end());
+        K.offsets.insert(K.offsets.end(), pad, strip.offsets.back());
+        K.indices = std::move(strip.indices);
+        K.weights = std::move(strip.weights);
+
+        extended.assign(K.size(), 0.0f);
+        dextended.assign(K.size(), 0.0f);
+    }
+
+    Kuramoto local;
+
+    // throws unless every strip has at least shells rows
+    static void check(int cells, int shells, int ranks)
+    {
+        const std::vector<uint64_t> strips = stripRows(cells, ranks);
+        for (int r = 0; r < ranks; r++)
+        {
+            if (strips[r+1]-strips[r] < uint64_t(shells))
+            {
+                throw std::runtime_error
+                (
+                    "Each of "+std::to_string(ranks)+" ranks needs at least "+
+                    std::to_string(shells)+" rows of "+std::to_string(cells)+", use fewer ranks"
+                );
+            }
+        }
+    }
+
+    // first global oscillator of this strip
+    uint64_t begin() const { return y0*cells; }
+
+    uint64_t size() const { return rows*cells; }
+
+    uint64_t edges() const { return local.K.edges(); }
+
+    std::vector<uint64_t> partition(unsigned count) const { return evenBlocks(size(), count); }
+
+    void interaction
+    (
+        const std::vector<float> & theta,
+        std::vector<float> & dtheta,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & blocks
+    )
+    {
+        const uint64_t pad = halo*uint64_t(cells);
+        std::copy(theta.begin(), theta.end(), extended.begin()+pad);
+        exchangeHalos();
+
+        if (local.mode == KernelMode::PHASOR)
+        {
+            local.phasors.resize(extended.size()*local.expansion_coefficients.size()*2);
+            parallelFor
+            (
+                pool,
+                evenBlocks(extended.size(), std::max(blocks.size(), size_t(2))-1),
+                [&](uint64_t begin, uint64_t end) { local.tabulatePhasors(extended, begin, end); }
+            );
+        }
+
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                local.interaction(extended, dextended, begin+pad, end+pad);
+                for (uint64_t i = begin; i < end; i++)
+                {
+                    dtheta[i] += dextended[i+pad];
+                    dextended[i+pad] = 0.0f;
+                }
+            }
+        );
+    }
+
+    // the whole of theta on rank 0 (theta is this strip), others send theirs
+    void gather(const std::vector<float> & theta, std::vector<float> & all)
+    {
+        if (transport.rank() != 0)
+        {
+            transport.send(0, theta.data(), theta.size()*sizeof(float));
+            return;
+        }
+        const std::vector<uint64_t> strips = stripRows(cells, transport.size());
+        all.resize(uint64_t(cells)*cells);
+        std::copy(theta.begin(), theta.end(), all.begin());
+        for (int r = 1; r < transport.size(); r++)
+        {
+            const uint64_t first = strips[r]*cells;
+            transport.recv(r, all.data()+first, (strips[r+1]*cells-first)*sizeof(float));
+        }
+    }
+
+    // sum of x over the ranks, on rank 0
+    uint64_t sum(uint64_t x)
+    {
+        if (transport.rank() != 0)
+        {
+            transport.send(0, &x, sizeof(x));
+            return x;
+        }
+        for (int r = 1; r < transport.size(); r++)
+        {
+            uint64_t y;
+            transport.recv(r, &y, sizeof(y));
+            x += y;
+        }
+        return x;
+    }
+
+private:
+
+    Transport & transport;
+    int cells;
+    uint64_t halo;
+    uint64_t y0, rows;
+    std::vector<float> extended, dextended;
+
+    /*
+        The top halo rows of the strip go up to the next rank's lower
+        halo, then the bottom halo rows down to the previous rank's
+        upper halo. Every rank makes the same two exchanges in the same
+        order, two ranks (or one) included.
+    */
+    void exchangeHalos()
+    {
+        const int ranks = transport.size();
+        const int next = (transport.rank()+1) % ranks;
+        const int prev = (transport.rank()+ranks-1) % ranks;
+        const uint64_t width = halo*uint64_t(cells);
+        const uint64_t bytes = width*sizeof(float);
+        float * data = extended.data();
+
+        transport.exchange(next, data+rows*cells, bytes, prev, data, bytes);
+        transport.exchange(prev, data+width, bytes, next, data+width+rows*cells, bytes);
+    }
+};
+
+#endif /* DOMAIN_H */
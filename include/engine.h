@@ -0,0 +1,58 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <jThread/jThread.h>
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+/*
+    A way of computing the Kuramoto coupling.
+
+    interaction adds sum_j K_ij kernel(theta_j-theta_i) to dtheta[i] for
+    every oscillator, normalisation by the neighbour count is left to
+    the caller. blocks is a split of the oscillators from partition(),
+    the engine may use it to spread work over the pool (which can be
+    null).
+*/
+class Engine
+{
+
+public:
+
+    virtual ~Engine() = default;
+
+    virtual void interaction
+    (
+        const std::vector<float> & theta,
+        std::vector<float> & dtheta,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & blocks
+    ) = 0;
+
+    // split the oscillators into count blocks of roughly equal work
+    virtual std::vector<uint64_t> partition(unsigned count) const = 0;
+
+    // number of oscillators
+    virtual uint64_t size() const = 0;
+
+    // pair couplings one interaction accounts for, for throughput figures
+    virtual uint64_t edges() const = 0;
+};
+
+// Kuramoto order parameter r = |sum_j e^{i theta_j}|/N
+double orderParameter(const std::vector<float> & theta)
+{
+    if (theta.size() == 0) { return 0.0; }
+    double c = 0.0;
+    double s = 0.0;
+    for (float t : theta)
+    {
+        c += std::cos(double(t));
+        s += std::sin(double(t));
+    }
+    return std::sqrt(c*c+s*s)/double(theta.size());
+}
+
+#endif /* ENGINE_H */
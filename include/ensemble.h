@@ -0,0 +1,273 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <kuramoto.h>
+#include <simdKernel.h>
+#include <philox.h>
+#include <parallel.h>
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <stdexcept>
+
+// the parameters one replica of an ensemble may change
+struct Replica
+{
+    uint64_t seed = 0;
+    float k = 10.0;
+    float o = 0.1;
+    float eta = 0.0;
+};
+
+/*
+    Many replicas of the stored graph model stepped in one pass over
+    the graph.
+
+    The replicas share K, built with k = 1 so each weight is the edge's
+    uniform draw, and counts. Each replica scales the weights by its own
+    k and has its own o, eta and seed, the seed draws its initial
+    conditions and noise as a single run of that seed would (Philox
+    streams 0 and 1).
+
+    theta is stored replica innermost, theta[i*stride+r], so the phases
+    of neighbour j for every replica are one contiguous run and each
+    edge's index and weight are read once for all of them. stride is
+    the replica count rounded up to LANES, the spare replicas have
+    k = o = eta = 0 and stay where they start.
+
+    Euler-Maruyama only. KernelMode::STD evaluates std::sin per replica
+    and replica r then matches a single -kernel std run with its
+    parameters bit for bit, SIMD runs 8 (AVX2) or 16 (AVX-512) replicas
+    per instruction with the polynomial sine, see simdKernel.h.
+*/
+class Ensemble
+{
+
+public:
+
+    static const unsigned LANES = 8;
+
+    Ensemble
+    (
+        Coupling && coupling,
+        const std::vector<int> & counts,
+        const std::vector<Replica> & replicas,
+        const std::vector<float> & expansion_coefficients,
+        const std::vector<float> & shifts,
+        KernelMode mode,
+        SimdLevel simd
+    )
+    : K(std::move(coupling)),
+      counts(counts),
+      replicas(replicas),
+      expansion_coefficients(expansion_coefficients),
+      shifts(shifts),
+      mode(mode),
+      simd(simd)
+    {
+        if (mode == KernelMode::PHASOR)
+        {
+            throw std::runtime_error("Ensembles support -kernel std or simd");
+        }
+        if (replicas.empty())
+        {
+            throw std::runtime_error("An ensemble needs at least one replica");
+        }
+
+        n = K.size();
+        stride = (replicas.size()+LANES-1)/LANES*LANES;
+        theta.assign(n*stride, 0.0f);
+        omega.assign(n*stride, 0.0f);
+        dtheta.assign(n*stride, 0.0f);
+        k.assign(stride, 0.0f);
+        D.assign(stride, 0.0f);
+
+        std::vector<float> drawn(n);
+        for (uint64_t r = 0; r < replicas.size(); r++)
+        {
+            k[r] = replicas[r].k;
+            Philox initial(replicas[r].seed, 0);
+            initial.uniform(0, 0, n, drawn.data());
+            for (uint64_t i = 0; i < n; i++) { omega[i*stride+r] = drawn[i]*replicas[r].o; }
+            initial.uniform(1, 0, n, drawn.data());
+            for (uint64_t i = 0; i < n; i++) { theta[i*stride+r] = drawn[i]*(2.0*3.14159); }
+            noiseRng.push_back(Philox(replicas[r].seed, 1));
+        }
+    }
+
+    Coupling K;
+    std::vector<int> counts;
+    std::vector<Replica> replicas;
+    std::vector<float> expansion_coefficients;
+    std::vector<float> shifts;
+    KernelMode mode;
+    SimdLevel simd;
+
+    // theta[i*stride+r] is oscillator i of replica r
+    std::vector<float> theta, omega;
+
+    uint64_t size() const { return n; }
+
+    unsigned width() const { return stride; }
+
+    uint64_t edges() const { return K.edges(); }
+
+    std::vector<uint64_t> partition(unsigned count) const { return K.partition(count); }
+
+    // one Euler-Maruyama step of every replica
+    void step(double dt, jThread::ThreadPool * pool, const std::vector<uint64_t> & blocks)
+    {
+        bool noisy = false;
+        for (uint64_t r = 0; r < replicas.size(); r++)
+        {
+            D[r] = std::sqrt(2.0*replicas[r].eta*1.0/dt);
+            noisy = noisy || D[r] > 0.0;
+        }
+        if (noisy && noise.size() != n*replicas.size())
+        {
+            noise.assign(n*replicas.size(), 0.0f);
+        }
+
+        // noise per replica in oscillator order (as NoiseStage), with the coupling
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t r = 0; r < replicas.size(); r++)
+                {
+                    if (D[r] > 0.0) { noiseRng[r].normal(steps, begin, end, noise.data()+r*n+begin); }
+                }
+                interaction(begin, end);
+            }
+        );
+
+        // as Integrator's euler, once every row has read theta
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t i = begin; i < end; i++)
+                {
+                    for (uint64_t r = 0; r < stride; r++)
+                    {
+                        const uint64_t ir = i*stride+r;
+                        const float xi = D[r] > 0.0 ? noise[r*n+i] : 0.0f;
+                        theta[ir] += dt * (omega[ir] + xi*D[r] + (1.0/float(counts[i]))*dtheta[ir]);
+                        theta[ir] = fmod(theta[ir], 2.0*3.14159);
+                        if (theta[ir] < 0) { theta[ir] += 2.0*3.14159; }
+                        dtheta[ir] = 0.0;
+                    }
+                }
+            }
+        );
+        steps++;
+    }
+
+    // accumulate the coupling of every replica into dtheta for rows [begin, end)
+    void interaction(uint64_t begin, uint64_t end)
+    {
+        const int * indices = K.indices.data();
+        const float * weights = K.weights.data();
+        const int harmonics = expansion_coefficients.size();
+
+        if (mode == KernelMode::SIMD)
+        {
+            EnsembleRow row = ensembleRow(simd);
+            for (uint64_t i = begin; i < end; i++)
+            {
+                const uint64_t e = K.offsets[i];
+                row
+                (
+                    theta.data(),
+                    indices+e,
+                    weights+e,
+                    K.offsets[i+1]-e,
+                    theta.data()+i*stride,
+                    k.data(),
+                    stride,
+                    expansion_coefficients.data(),
+                    shifts.data(),
+                    harmonics,
+                    dtheta.data()+i*stride
+                );
+            }
+            return;
+        }
+
+        // as Kuramoto's STD loop per replica, the weight scaled first, padding lanes skipped
+        const uint64_t used = replicas.size();
+        for (uint64_t i = begin; i < end; i++)
+        {
+            const float * ti = theta.data()+i*stride;
+            for (uint64_t g = 0; g < used; g += LANES)
+            {
+                const unsigned lanes = std::min(uint64_t(LANES), used-g);
+                float d[LANES] = {0.0};
+                for (uint64_t e = K.offsets[i]; e < K.offsets[i+1]; e++)
+                {
+                    const float * tj = theta.data()+uint64_t(indices[e])*stride+g;
+                    for (unsigned l = 0; l < lanes; l++)
+                    {
+                        d[l] += (k[g+l]*weights[e])*kernel(tj[l]-ti[g+l]);
+                    }
+                }
+                for (unsigned l = 0; l < lanes; l++) { dtheta[i*stride+g+l] += d[l]; }
+            }
+        }
+    }
+
+    float kernel(float phi) const
+    {
+        float s = 0.0;
+        for (uint64_t i = 0; i < expansion_coefficients.size(); i++)
+        {
+            s += expansion_coefficients[i]*std::sin((i+1)*phi+shifts[i]);
+        }
+        return s;
+    }
+
+    // replica r's phases, in oscillator order
+    std::vector<float> replica(uint64_t r) const
+    {
+        std::vector<float> t(n);
+        for (uint64_t i = 0; i < n; i++) { t[i] = theta[i*stride+r]; }
+        return t;
+    }
+
+    // the order parameter of each replica, as orderParameter
+    std::vector<double> orderParameters() const
+    {
+        std::vector<double> c(replicas.size(), 0.0), s(replicas.size(), 0.0);
+        for (uint64_t i = 0; i < n; i++)
+        {
+            for (uint64_t r = 0; r < replicas.size(); r++)
+            {
+                c[r] += std::cos(double(theta[i*stride+r]));
+                s[r] += std::sin(double(theta[i*stride+r]));
+            }
+        }
+        std::vector<double> order(replicas.size(), 0.0);
+        for (uint64_t r = 0; r < replicas.size() && n > 0; r++)
+        {
+            order[r] = std::sqrt(c[r]*c[r]+s[r]*s[r])/double(n);
+        }
+        return order;
+    }
+
+private:
+
+    uint64_t n, stride;
+    // steps taken, the noise counter
+    uint64_t steps = 0;
+    std::vector<float> dtheta, noise, k, D;
+    std::vector<Philox> noiseRng;
+};
+
+#endif /* ENSEMBLE_H */
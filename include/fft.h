@@ -0,0 +1,204 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <parallel.h>
+
+#include <vector>
+#include <complex>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <stdexcept>
+
+/*
+    Radix-2 complex FFT of length n (a power of 2), in place.
+
+    Twiddles and the bit reversal permutation are computed once, so a
+    plan can be shared by many threads transforming different rows.
+*/
+class FFT
+{
+
+public:
+
+    FFT(uint64_t n = 1)
+    : n(n)
+    {
+        if (n == 0 || (n & (n-1)) != 0)
+        {
+            throw std::runtime_error("FFT length must be a power of 2, got "+std::to_string(n));
+        }
+
+        uint64_t bits = 0;
+        while ((uint64_t(1) << bits) < n) { bits++; }
+
+        reversed.resize(n);
+        for (uint64_t i = 0; i < n; i++)
+        {
+            uint64_t r = 0;
+            for (uint64_t b = 0; b < bits; b++)
+            {
+                r |= ((i >> b) & 1) << (bits-1-b);
+            }
+            reversed[i] = r;
+        }
+
+        twiddles.resize(n/2 > 0 ? n/2 : 1);
+        for (uint64_t k = 0; k < n/2; k++)
+        {
+            double a = -2.0*3.14159265358979323846*double(k)/double(n);
+            twiddles[k] = std::complex<double>(std::cos(a), std::sin(a));
+        }
+    }
+
+    uint64_t size() const { return n; }
+
+    // forward transform (e^{-2 pi i jk/n}), or the unscaled inverse
+    void transform(std::complex<double> * x, bool inverse = false) const
+    {
+        for (uint64_t i = 0; i < n; i++)
+        {
+            if (i < reversed[i]) { std::swap(x[i], x[reversed[i]]); }
+        }
+
+        for (uint64_t len = 2; len <= n; len <<= 1)
+        {
+            const uint64_t half = len/2;
+            const uint64_t step = n/len;
+            for (uint64_t i = 0; i < n; i += len)
+            {
+                for (uint64_t k = 0; k < half; k++)
+                {
+                    const std::complex<double> w = twiddles[k*step];
+                    const double wi = inverse ? -w.imag() : w.imag();
+                    const std::complex<double> u = x[i+k];
+                    const std::complex<double> t = x[i+k+half];
+                    // written out, std::complex operator* checks for inf/nan
+                    const std::complex<double> v
+                    (
+                        t.real()*w.real()-t.imag()*wi,
+                        t.real()*wi+t.imag()*w.real()
+                    );
+                    x[i+k] = u+v;
+                    x[i+k+half] = u-v;
+                }
+            }
+        }
+    }
+
+private:
+
+    uint64_t n;
+    std::vector<uint64_t> reversed;
+    std::vector<std::complex<double>> twiddles;
+};
+
+/*
+    2D FFT of an n x n row-major grid.
+
+    forward leaves the spectrum transposed (rows, transpose, rows) and
+    inverse undoes exactly that, so a pointwise product of two forward
+    spectra followed by inverse is a periodic convolution without ever
+    transposing back. The inverse is scaled by 1/n^2.
+*/
+class FFT2D
+{
+
+public:
+
+    FFT2D(uint64_t n = 1)
+    : n(n), plan(n), scratch(n*n)
+    {}
+
+    uint64_t size() const { return n; }
+
+    void forward
+    (
+        std::vector<std::complex<double>> & x,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & rows
+    )
+    {
+        transformRows(x, false, pool, rows);
+        transpose(x, pool, rows);
+        transformRows(x, false, pool, rows);
+    }
+
+    void inverse
+    (
+        std::vector<std::complex<double>> & x,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & rows
+    )
+    {
+        transformRows(x, true, pool, rows);
+        transpose(x, pool, rows);
+        transformRows(x, true, pool, rows);
+        const double scale = 1.0/double(n*n);
+        parallelFor
+        (
+            pool,
+            rows,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t i = begin*n; i < end*n; i++) { x[i] *= scale; }
+            }
+        );
+    }
+
+private:
+
+    uint64_t n;
+    FFT plan;
+    std::vector<std::complex<double>> scratch;
+
+    void transformRows
+    (
+        std::vector<std::complex<double>> & x,
+        bool inverse,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & rows
+    )
+    {
+        parallelFor
+        (
+            pool,
+            rows,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t r = begin; r < end; r++) { plan.transform(&x[r*n], inverse); }
+            }
+        );
+    }
+
+    void transpose
+    (
+        std::vector<std::complex<double>> & x,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & rows
+    )
+    {
+        parallelFor
+        (
+            pool,
+            rows,
+            [&](uint64_t begin, uint64_t end)
+            {
+                // in tiles so the strided reads stay in cache
+                const uint64_t tile = 32;
+                for (uint64_t c0 = 0; c0 < n; c0 += tile)
+                {
+                    const uint64_t c1 = std::min(c0+tile, n);
+                    for (uint64_t r = begin; r < end; r++)
+                    {
+                        for (uint64_t c = c0; c < c1; c++) { scratch[r*n+c] = x[c*n+r]; }
+                    }
+                }
+            }
+        );
+        x.swap(scratch);
+    }
+};
+
+#endif /* FFT_H */
@@ -0,0 +1,213 @@
+#ifndef FIXEDPHASE_H
+#define FIXEDPHASE_H
+
+#include <kuramoto.h>
+#include <parallel.h>
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <limits>
+#include <stdexcept>
+#include <cstdint>
+#include <cmath>
+
+/*
+    Phases stored as fixed point turns, theta = phase * 2pi / 2^bits with
+    phase an unsigned 16 or 32 bit integer.
+
+    Wrapping to [0, 2pi) is unsigned overflow, phase differences are one
+    integer subtraction, and the kernel is read from a 4096 entry table
+    of the full expansion sum_n c_n sin(n phi + s_n) with linear
+    interpolation on the remaining bits. 16 bit phases halve the theta
+    traffic of the float path.
+
+    Only the graph (Coupling) engine and Euler-Maruyama stepping are
+    supported. The increment of each step is rounded to the nearest
+    phase unit (2pi/65536 ~ 9.6e-5 rad at 16 bits).
+*/
+class FixedPhase
+{
+
+public:
+
+    virtual ~FixedPhase() = default;
+
+    virtual void step
+    (
+        const Coupling & K,
+        const std::vector<float> & omega,
+        const std::vector<int> & counts,
+        const std::vector<float> & noise,
+        float D,
+        double dt,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & blocks
+    ) = 0;
+
+    // phase in turns, [0, 1)
+    virtual float turns(uint64_t i) const = 0;
+
+    virtual void set(const std::vector<float> & theta) = 0;
+
+    virtual void get(std::vector<float> & theta) const = 0;
+
+    virtual uint64_t bytes() const = 0;
+};
+
+template <class T>
+class FixedPhaseKuramoto : public FixedPhase
+{
+
+public:
+
+    static const unsigned BITS = std::numeric_limits<T>::digits;
+    static const unsigned TABLE_BITS = 12;
+    static const unsigned FRACTION_BITS = BITS-TABLE_BITS;
+
+    FixedPhaseKuramoto
+    (
+        const std::vector<float> & expansion_coefficients,
+        const std::vector<float> & shifts
+    )
+    {
+        const uint64_t size = uint64_t(1) << TABLE_BITS;
+        // one extra entry so interpolation never wraps the index
+        table.resize(size+1);
+        for (uint64_t t = 0; t <= size; t++)
+        {
+            double phi = 2.0*3.14159265358979323846*double(t)/double(size);
+            double k = 0.0;
+            for (uint64_t n = 0; n < expansion_coefficients.size(); n++)
+            {
+                k += expansion_coefficients[n]*std::sin((n+1)*phi+shifts[n]);
+            }
+            table[t] = k;
+        }
+    }
+
+    void set(const std::vector<float> & theta)
+    {
+        phase.resize(theta.size());
+        dtheta.assign(theta.size(), 0.0f);
+        for (uint64_t i = 0; i < theta.size(); i++)
+        {
+            phase[i] = toPhase(theta[i]);
+        }
+    }
+
+    void get(std::vector<float> & theta) const
+    {
+        theta.resize(phase.size());
+        for (uint64_t i = 0; i < phase.size(); i++)
+        {
+            theta[i] = turns(i)*2.0*3.14159265358979323846;
+        }
+    }
+
+    float turns(uint64_t i) const
+    {
+        return float(double(phase[i])/UNITS);
+    }
+
+    uint64_t bytes() const { return phase.capacity()*sizeof(T); }
+
+    float kernel(T phi) const
+    {
+        const uint64_t index = uint64_t(phi) >> FRACTION_BITS;
+        const float fraction = float(uint64_t(phi) & FRACTION_MASK)*FRACTION_SCALE;
+        return table[index]+fraction*(table[index+1]-table[index]);
+    }
+
+    void step
+    (
+        const Coupling & K,
+        const std::vector<float> & omega,
+        const std::vector<int> & counts,
+        const std::vector<float> & noise,
+        float D,
+        double dt,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & blocks
+    )
+    {
+        const int * indices = K.indices.data();
+        const float * weights = K.weights.data();
+        const T * p = phase.data();
+
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t i = begin; i < end; i++)
+                {
+                    const T pi = p[i];
+                    float d = 0.0;
+                    for (uint64_t e = K.offsets[i]; e < K.offsets[i+1]; e++)
+                    {
+                        d += weights[e]*kernel(T(p[indices[e]]-pi));
+                    }
+                    dtheta[i] = d;
+                }
+            }
+        );
+
+        const double scale = UNITS/(2.0*3.14159265358979323846);
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t i = begin; i < end; i++)
+                {
+                    const float xi = D > 0.0 ? noise[i] : 0.0f;
+                    double increment = dt*(omega[i]+xi*D+(1.0/float(counts[i]))*dtheta[i]);
+                    // wraps modulo 2^BITS, i.e. modulo 2pi
+                    phase[i] += T(int64_t(std::llround(increment*scale)));
+                }
+            }
+        );
+    }
+
+private:
+
+    static constexpr double UNITS = double(uint64_t(1) << BITS);
+    static const uint64_t FRACTION_MASK = (uint64_t(1) << FRACTION_BITS)-1;
+    static constexpr float FRACTION_SCALE = 1.0f/float(uint64_t(1) << FRACTION_BITS);
+
+    std::vector<T> phase;
+    std::vector<float> dtheta;
+    std::vector<float> table;
+
+    static T toPhase(float theta)
+    {
+        double t = theta/(2.0*3.14159265358979323846);
+        t -= std::floor(t);
+        return T(uint64_t(std::llround(t*UNITS)) & (uint64_t(UNITS)-1));
+    }
+};
+
+// "fixed16" or "fixed32", "float" (the default path) gives nullptr
+std::unique_ptr<FixedPhase> fixedPhaseFromString
+(
+    std::string type,
+    const std::vector<float> & expansion_coefficients,
+    const std::vector<float> & shifts
+)
+{
+    if (type == "float") { return nullptr; }
+    if (type == "fixed16")
+    {
+        return std::make_unique<FixedPhaseKuramoto<uint16_t>>(expansion_coefficients, shifts);
+    }
+    if (type == "fixed32")
+    {
+        return std::make_unique<FixedPhaseKuramoto<uint32_t>>(expansion_coefficients, shifts);
+    }
+    throw std::runtime_error("Unknown phase type: "+type);
+}
+
+#endif /* FIXEDPHASE_H */
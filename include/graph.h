@@ -0,0 +1,296 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <kuramoto.h>
+#include <parallel.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <stdexcept>
+
+// splitmix64 finaliser
+inline uint64_t mix64(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// 24 bits of h from bit shift up, as a float in [0, 1)
+inline float hashUniform(uint64_t h, unsigned shift)
+{
+    return float((h >> shift) & 0xFFFFFF)*(1.0f/16777216.0f);
+}
+
+/*
+    How HashedGraph::row draws the long range edges.
+
+        BOX   one hash per candidate in the (2 shells+1)^2 box, accepted
+              if it falls below kp/(kd d). Cost grows with candidates.
+        SKIP  Chebyshev rings of the box in turn, jumping between
+              accepted candidates with geometric skips at the ring's
+              largest acceptance then thinning to kp/(kd d). Cost grows
+              with the edges kept. Same distribution, different draws,
+              while 2 shells+1 <= cells (a larger box wraps and BOX
+              repeats cells, each repeat sharing one draw).
+*/
+enum class Sampler { BOX, SKIP };
+
+Sampler samplerFromString(std::string sampler)
+{
+    if (sampler == "box") { return Sampler::BOX; }
+    if (sampler == "skip") { return Sampler::SKIP; }
+    throw std::runtime_error("Unknown sampler: "+sampler);
+}
+
+/*
+    The random long range graph on the cells x cells torus, as a pure
+    function of (seed, i).
+
+    Each cell within shells of oscillator i is a neighbour with
+    probability kp/(kd d), d the squared periodic distance, and coupling
+    k U(0,1). Every draw is a hash of the seed, i and a counter, so a
+    row can be regenerated anywhere, in any order, on any thread, and a
+    stored graph and the implicit engine built from the same seed agree
+    exactly.
+*/
+struct HashedGraph
+{
+    uint64_t seed = 0;
+    int cells = 1;
+    int shells = 0;
+    float k = 1.0;
+    float kp = 1.0;
+    float kd = 1.0;
+    Sampler sampler = Sampler::BOX;
+
+    uint64_t size() const { return uint64_t(cells)*cells; }
+
+    /*
+        Call f(j, w) for every edge of row i, always in the same order
+        for a given sampler.
+    */
+    template <class F>
+    void row(int i, F f) const
+    {
+        if (sampler == Sampler::SKIP) { rowSkip(i, f); }
+        else { rowBox(i, f); }
+    }
+
+    // edges of row i
+    int degree(int i) const
+    {
+        int count = 0;
+        row(i, [&count](int, float) { count++; });
+        return count;
+    }
+
+private:
+
+    // periodic image of offset n in [-cells/2, cells/2)
+    int wrap(int n) const
+    {
+        n %= cells;
+        if (n < 0) { n += cells; }
+        if (n >= 0.5*cells) { n -= cells; }
+        return n;
+    }
+
+    // x offset outer, y offset inner, one hash of (seed, i, j) each
+    template <class F>
+    void rowBox(int i, F f) const
+    {
+        const int x = i%cells;
+        const int y = i/cells;
+        const uint64_t key = mix64(seed ^ mix64(uint64_t(i)));
+        for (int n = -shells; n <= shells; n++)
+        {
+            int ix = (n+x) % cells;
+            if (ix < 0) { ix += cells; }
+            int rx = x-ix;
+            if (rx < 0.5*cells) { rx += cells; }
+            if (rx >= 0.5*cells) { rx -= cells; }
+            for (int m = -shells; m <= shells; m++)
+            {
+                int iy = (m+y) % cells;
+                if (iy < 0) { iy += cells; }
+
+                int ry = y-iy;
+                if (ry < 0.5*cells) { ry += cells; }
+                if (ry >= 0.5*cells) { ry -= cells; }
+                float d = float(rx*rx+ry*ry);
+
+                const int j = iy*cells+ix;
+                const uint64_t h = mix64(key+uint64_t(j));
+                if (hashUniform(h, 40) < kp*(1/(kd*d)))
+                {
+                    f(j, k*hashUniform(h, 8));
+                }
+            }
+        }
+    }
+
+    /*
+        Ring r holds the 8r cells with max(|n|, |m|) = r, walked
+        anticlockwise from (-r, -r). The smallest periodic distance on
+        the ring bounds the acceptance by p, the gap to the next
+        candidate is geometric in p and a candidate at distance d is
+        kept with probability (kp/(kd d))/p. The draws are a counter
+        hash per row, so they do not depend on j.
+    */
+    template <class F>
+    void rowSkip(int i, F f) const
+    {
+        const int x = i%cells;
+        const int y = i/cells;
+        const uint64_t key = mix64(seed ^ mix64(uint64_t(i)) ^ 0x5851F42D4C957F2Dull);
+        uint64_t counter = 0;
+
+        auto visit = [&](int r, int64_t q, uint64_t h, float p)
+        {
+            int n = -r, m = -r;
+            if (r > 0)
+            {
+                const int side = q/(2*r);
+                const int t = q%(2*r);
+                if (side == 0) { n = -r+t; m = -r; }
+                else if (side == 1) { n = r; m = -r+t; }
+                else if (side == 2) { n = r-t; m = r; }
+                else { n = -r; m = r-t; }
+            }
+            const int rx = wrap(n);
+            const int ry = wrap(m);
+            const float d = float(rx*rx+ry*ry);
+            if (hashUniform(h, 40)*p < kp*(1/(kd*d)))
+            {
+                int ix = (x+n) % cells;
+                if (ix < 0) { ix += cells; }
+                int iy = (y+m) % cells;
+                if (iy < 0) { iy += cells; }
+                f(iy*cells+ix, k*hashUniform(mix64(h), 8));
+            }
+        };
+
+        for (int r = 0; r <= shells; r++)
+        {
+            const int64_t candidates = r == 0 ? 1 : 8*r;
+            const int near = std::abs(wrap(r));
+            const float p = near == 0 ? 1.0f : std::min(1.0f, kp*(1/(kd*float(near*near))));
+            if (p <= 0.0f) { continue; }
+
+            if (p >= 1.0f)
+            {
+                for (int64_t q = 0; q < candidates; q++)
+                {
+                    visit(r, q, mix64(key+counter++), 1.0f);
+                }
+                continue;
+            }
+
+            const double logMiss = std::log1p(-double(p));
+            int64_t q = -1;
+            while (true)
+            {
+                const uint64_t h = mix64(key+counter++);
+                // 53 bits in (0, 1], 24 would cap the skip near 17/p
+                const double u = 1.0-double(h >> 11)*(1.0/9007199254740992.0);
+                const double skip = std::floor(std::log(u)/logMiss);
+                if (skip >= double(candidates-1-q)) { break; }
+                q += int64_t(skip)+1;
+                visit(r, q, mix64(h), p);
+            }
+        }
+    }
+};
+
+/*
+    Rows first ... first+count-1 of graph into K as its rows 0 ...
+    count-1, neighbour j of row i stored as column(i, j). counts[r] is
+    the neighbour count plus one, the normalisation used by the
+    integrator and the shader. blocks split [0, count).
+
+    Two passes over blocks of rows. The first only counts each row's
+    edges, a prefix sum over the counts gives the offsets, the second
+    generates the rows again straight into place. Each edge is a hash of
+    (seed, i, j), so regenerating is cheap, the result does not depend
+    on the pool or the blocks, and nothing beyond K is held.
+*/
+template <class C>
+void buildRows
+(
+    Coupling & K,
+    std::vector<int> & counts,
+    const HashedGraph & graph,
+    uint64_t first,
+    uint64_t count,
+    C column,
+    jThread::ThreadPool * pool,
+    const std::vector<uint64_t> & blocks
+)
+{
+    counts.assign(count, 0);
+
+    parallelFor
+    (
+        pool,
+        blocks,
+        [&](uint64_t begin, uint64_t end)
+        {
+            for (uint64_t r = begin; r < end; r++)
+            {
+                counts[r] = graph.degree(first+r)+1;
+            }
+        }
+    );
+
+    K.offsets.assign(count+1, 0);
+    for (uint64_t r = 0; r < count; r++)
+    {
+        K.offsets[r+1] = K.offsets[r]+counts[r]-1;
+    }
+    // exact sizes, no shrink needed
+    K.indices = std::vector<int>(K.offsets[count]);
+    K.weights = std::vector<float>(K.offsets[count]);
+
+    parallelFor
+    (
+        pool,
+        blocks,
+        [&](uint64_t begin, uint64_t end)
+        {
+            for (uint64_t r = begin; r < end; r++)
+            {
+                const uint64_t i = first+r;
+                uint64_t e = K.offsets[r];
+                graph.row
+                (
+                    i,
+                    [&](int j, float w)
+                    {
+                        K.indices[e] = column(i, j);
+                        K.weights[e] = w;
+                        e++;
+                    }
+                );
+            }
+        }
+    );
+}
+
+// the whole graph into K, blocks split [0, graph.size())
+void buildGraph
+(
+    Coupling & K,
+    std::vector<int> & counts,
+    const HashedGraph & graph,
+    jThread::ThreadPool * pool,
+    const std::vector<uint64_t> & blocks
+)
+{
+    buildRows(K, counts, graph, 0, graph.size(), [](uint64_t, int j) { return j; }, pool, blocks);
+}
+
+#endif /* GRAPH_H */
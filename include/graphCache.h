@@ -0,0 +1,277 @@
+#ifndef GRAPHCACHE_H
+#define GRAPHCACHE_H
+
+#include <kuramoto.h>
+#include <graph.h>
+#include <mappedFile.h>
+
+#include <vector>
+#include <string>
+#include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+
+#ifndef WINDOWS
+#include <unistd.h>
+#endif
+
+/*
+    Stored graphs on disk, one file per HashedGraph, named by a hash of
+    every parameter that shapes it (cells, shells, k, kp, kd, seed and
+    sampler). The layout is flat
+
+        header     magic "KURAGRPH", version, the parameters, n, edges
+        offsets    uint64[n+1]
+        indices    int32[edges]
+        weights    float[edges]
+
+    each section on a 64 byte boundary, so a load maps the file and
+    copies the sections out. The parameters are checked on load as
+    well, a key collision is a miss. counts follow from the offsets.
+
+    Files are written to a .tmp, synced and renamed. After each store the
+    least recently used files (by modification time, a hit touches it)
+    are removed until the directory is within limit bytes.
+*/
+
+const char GRAPH_CACHE_MAGIC[8] = {'K', 'U', 'R', 'A', 'G', 'R', 'P', 'H'};
+const uint32_t GRAPH_CACHE_VERSION = 1;
+
+struct GraphCacheHeader
+{
+    char magic[8];
+    uint32_t version = GRAPH_CACHE_VERSION;
+    uint32_t sampler = 0;
+    int32_t cells = 0;
+    int32_t shells = 0;
+    float k = 0.0;
+    float kp = 0.0;
+    float kd = 0.0;
+    float unused = 0.0;
+    uint64_t seed = 0;
+    uint64_t n = 0;
+    uint64_t edges = 0;
+};
+
+class GraphCache
+{
+
+public:
+
+    GraphCache(std::string directory, uint64_t limit)
+    : directory(directory), limit(limit)
+    {
+        std::filesystem::create_directories(directory);
+    }
+
+    static GraphCacheHeader header(const HashedGraph & graph)
+    {
+        GraphCacheHeader h;
+        std::memcpy(h.magic, GRAPH_CACHE_MAGIC, sizeof(h.magic));
+        h.sampler = uint32_t(graph.sampler);
+        h.cells = graph.cells;
+        h.shells = graph.shells;
+        h.k = graph.k;
+        h.kp = graph.kp;
+        h.kd = graph.kd;
+        h.seed = graph.seed;
+        h.n = graph.size();
+        return h;
+    }
+
+    // hash of the parameter bytes of the header
+    static uint64_t key(const HashedGraph & graph)
+    {
+        const GraphCacheHeader h = header(graph);
+        const uint64_t words[] =
+        {
+            h.sampler,
+            uint64_t(uint32_t(h.cells)),
+            uint64_t(uint32_t(h.shells)),
+            bits(h.k),
+            bits(h.kp),
+            bits(h.kd),
+            h.seed
+        };
+        uint64_t x = GRAPH_CACHE_VERSION;
+        for (uint64_t w : words) { x = mix64(x ^ w); }
+        return x;
+    }
+
+    std::string path(const HashedGraph & graph) const
+    {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.graph", (unsigned long long)key(graph));
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    /*
+        Fill K and counts (neighbours plus one, as buildGraph) from the
+        cache, false on a miss or a file that does not match. A file
+        whose graph is not Coupling::valid is removed. Throws if the
+        file exists but cannot be read.
+    */
+    bool load(const HashedGraph & graph, Coupling & K, std::vector<int> & counts)
+    {
+        const std::string file = path(graph);
+        std::error_code error;
+        if (!std::filesystem::exists(file, error))
+        {
+            return false;
+        }
+
+        const MappedFile map(file);
+        GraphCacheHeader h;
+        if (map.size() < sizeof(h))
+        {
+            return false;
+        }
+        std::memcpy(&h, map.data(), sizeof(h));
+        GraphCacheHeader expected = header(graph);
+        expected.edges = h.edges;
+        if (std::memcmp(&h, &expected, sizeof(h)) != 0)
+        {
+            return false;
+        }
+        const Layout layout(h);
+        if (layout.size != map.size())
+        {
+            return false;
+        }
+
+        map.copy(K.offsets, layout.offsets, h.n+1);
+        map.copy(K.indices, layout.indices, h.edges);
+        map.copy(K.weights, layout.weights, h.edges);
+        if (!K.valid(h.n))
+        {
+            // corrupt, a miss and rebuilt
+            K.clear();
+            std::filesystem::remove(file, error);
+            return false;
+        }
+        counts.resize(h.n);
+        for (uint64_t i = 0; i < h.n; i++)
+        {
+            counts[i] = int(K.degree(i))+1;
+        }
+
+        std::filesystem::last_write_time(file, std::filesystem::file_time_type::clock::now(), error);
+        return true;
+    }
+
+    // write K for graph then evict down to the limit, throws if it cannot write
+    void store(const HashedGraph & graph, const Coupling & K)
+    {
+        GraphCacheHeader h = header(graph);
+        h.edges = K.edges();
+        const Layout layout(h);
+
+        const std::string file = path(graph);
+        const std::string tmp = file+".tmp";
+        FILE * out = std::fopen(tmp.c_str(), "wb");
+        if (out == nullptr)
+        {
+            throw std::runtime_error("Could not open graph cache "+tmp);
+        }
+
+        SectionWriter writer(out);
+
+        writer.section(0, &h, sizeof(h));
+        writer.section(layout.offsets, K.offsets.data(), (h.n+1)*sizeof(uint64_t));
+        writer.section(layout.indices, K.indices.data(), h.edges*sizeof(int32_t));
+        writer.section(layout.weights, K.weights.data(), h.edges*sizeof(float));
+        writer.section(layout.size, nullptr, 0);
+        bool ok = std::fflush(out) == 0 && writer.ok();
+#ifndef WINDOWS
+        ok = fsync(fileno(out)) == 0 && ok;
+#endif
+        ok = std::fclose(out) == 0 && ok;
+        if (!ok)
+        {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Could not write graph cache "+tmp);
+        }
+
+#ifdef WINDOWS
+        std::remove(file.c_str());
+#endif
+        if (std::rename(tmp.c_str(), file.c_str()) != 0)
+        {
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Could not rename graph cache "+tmp+" to "+file);
+        }
+
+        evict(file);
+    }
+
+private:
+
+    struct Layout
+    {
+        Layout(const GraphCacheHeader & h)
+        {
+            auto align = [](uint64_t at) { return (at+63)/64*64; };
+            offsets = align(sizeof(GraphCacheHeader));
+            indices = align(offsets+(h.n+1)*sizeof(uint64_t));
+            weights = align(indices+h.edges*sizeof(int32_t));
+            size = weights+h.edges*sizeof(float);
+        }
+
+        uint64_t offsets, indices, weights, size;
+    };
+
+    std::string directory;
+    uint64_t limit;
+
+    static uint64_t bits(float x)
+    {
+        uint32_t b;
+        std::memcpy(&b, &x, sizeof(b));
+        return b;
+    }
+
+    // oldest first until within limit, never the file just stored
+    void evict(const std::string & keep)
+    {
+        struct Entry
+        {
+            std::filesystem::path path;
+            std::filesystem::file_time_type time;
+            uint64_t size;
+        };
+
+        std::error_code error;
+        std::vector<Entry> entries;
+        uint64_t total = 0;
+        for (const auto & entry : std::filesystem::directory_iterator(directory, error))
+        {
+            if (entry.path().extension() != ".graph") { continue; }
+            const uint64_t size = entry.file_size(error);
+            if (error) { continue; }
+            entries.push_back({entry.path(), entry.last_write_time(error), size});
+            total += size;
+        }
+
+        std::sort
+        (
+            entries.begin(),
+            entries.end(),
+            [](const Entry & a, const Entry & b) { return a.time < b.time; }
+        );
+
+        for (const Entry & e : entries)
+        {
+            if (total <= limit) { break; }
+            if (e.path == std::filesystem::path(keep)) { continue; }
+            if (std::filesystem::remove(e.path, error))
+            {
+                total -= e.size;
+            }
+        }
+    }
+};
+
+#endif /* GRAPHCACHE_H */
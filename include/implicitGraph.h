@@ -0,0 +1,104 @@
+#ifndef IMPLICITGRAPH_H
+#define IMPLICITGRAPH_H
+
+#include <engine.h>
+#include <parallel.h>
+#include <graph.h>
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+/*
+    The HashedGraph coupling without storing it, every edge and weight is
+    regenerated from the hash inside the interaction loop, as the shader
+    does on the GPU. Memory is O(N) (only the caller's counts) at the
+    price of (2 shells+1)^2 hashes per oscillator per evaluation.
+
+    Rows are visited in the same order as buildGraph fills them, so the
+    result is bit identical to a Kuramoto engine (STD kernel) holding
+    the stored graph of the same seed.
+*/
+struct ImplicitKuramoto : public Engine
+{
+    HashedGraph graph;
+    std::vector<float> expansion_coefficients = {1.0};
+    std::vector<float> shifts = {0.0};
+
+    std::vector<uint64_t> partition(unsigned count) const { return evenBlocks(size(), count); }
+
+    uint64_t size() const { return graph.size(); }
+
+    uint64_t edges() const { return edgeCount; }
+
+    /*
+        Neighbour count plus one per oscillator, as buildGraph gives,
+        also records the edge total for edges().
+    */
+    void degrees
+    (
+        std::vector<int> & counts,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & blocks
+    )
+    {
+        counts.assign(size(), 0);
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t i = begin; i < end; i++) { counts[i] = graph.degree(i)+1; }
+            }
+        );
+        edgeCount = 0;
+        for (int c : counts) { edgeCount += c-1; }
+    }
+
+    void interaction
+    (
+        const std::vector<float> & theta,
+        std::vector<float> & dtheta,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & blocks
+    )
+    {
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t i = begin; i < end; i++)
+                {
+                    const float ti = theta[i];
+                    float d = 0.0;
+                    graph.row
+                    (
+                        i,
+                        [&](int j, float w) { d += w*kernel(theta[j]-ti); }
+                    );
+                    dtheta[i] += d;
+                }
+            }
+        );
+    }
+
+    // as Kuramoto::kernel
+    float kernel(float phi) const
+    {
+        float k = 0.0;
+        for (uint64_t i = 0; i < expansion_coefficients.size(); i++)
+        {
+            k += expansion_coefficients[i]*std::sin((i+1)*phi+shifts[i]);
+        }
+        return k;
+    }
+
+private:
+
+    uint64_t edgeCount = 0;
+};
+
+#endif /* IMPLICITGRAPH_H */
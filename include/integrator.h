@@ -0,0 +1,299 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include <engine.h>
+#include <parallel.h>
+#include <numa.h>
+
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include <cmath>
+
+/*
+    Time stepping for
+
+        dtheta_i = (omega_i + coupling_i(theta)/counts_i) dt + sqrt(2 eta) dW_i
+
+    EULER  Euler-Maruyama, one coupling evaluation per step (the original
+           scheme, kept bit for bit).
+    HEUN   stochastic Heun, a predictor-corrector using the same noise
+           increment in both stages. Two evaluations, strong order 1 for
+           additive noise and second order when eta = 0.
+    RK4    classical Runge-Kutta on the drift, four evaluations, with the
+           noise increment added after the deterministic step. Intended
+           for eta = 0 where it is fourth order.
+*/
+enum class Scheme { EULER, HEUN, RK4 };
+
+Scheme schemeFromString(std::string scheme)
+{
+    if (scheme == "euler") { return Scheme::EULER; }
+    if (scheme == "heun") { return Scheme::HEUN; }
+    if (scheme == "rk4") { return Scheme::RK4; }
+    throw std::runtime_error("Unknown integrator: "+scheme);
+}
+
+/*
+    Owns the stage buffers so stepping never allocates once sized. They
+    are placed by blocks when sized, see numa.h.
+
+    noise holds one standard normal per oscillator for this step (it is
+    only read if D > 0), D is the amplitude as used by the main loop,
+    sqrt(2 eta / dt). theta is wrapped to [0, 2pi) after each step.
+*/
+class Integrator
+{
+
+public:
+
+    Integrator(Scheme scheme = Scheme::EULER)
+    : scheme(scheme)
+    {}
+
+    Scheme scheme;
+
+    void step
+    (
+        Engine & engine,
+        std::vector<float> & theta,
+        const std::vector<float> & omega,
+        const std::vector<int> & counts,
+        const std::vector<float> & noise,
+        float D,
+        double dt,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & blocks
+    )
+    {
+        const uint64_t n = theta.size();
+        if (dtheta.size() != n)
+        {
+            dtheta.assign(n, 0.0f);
+            k1.assign(n, 0.0f);
+            k2.assign(n, 0.0f);
+            stage.assign(n, 0.0f);
+            for (std::vector<float> * buffer : {&dtheta, &k1, &k2, &stage})
+            {
+                placePages(*buffer, pool, blocks);
+            }
+        }
+
+        switch (scheme)
+        {
+            case Scheme::HEUN:
+                heun(engine, theta, omega, counts, noise, D, dt, pool, blocks);
+                break;
+            case Scheme::RK4:
+                rk4(engine, theta, omega, counts, noise, D, dt, pool, blocks);
+                break;
+            default:
+                euler(engine, theta, omega, counts, noise, D, dt, pool, blocks);
+                break;
+        }
+    }
+
+    // coupling evaluations per step
+    unsigned evaluations() const
+    {
+        switch (scheme)
+        {
+            case Scheme::HEUN: return 2;
+            case Scheme::RK4: return 4;
+            default: return 1;
+        }
+    }
+
+private:
+
+    std::vector<float> dtheta, k1, k2, stage;
+
+    static void wrap(float & t)
+    {
+        t = fmod(t, 2.0*3.14159);
+        if (t < 0)
+        {
+            t += 2.0*3.14159;
+        }
+    }
+
+    // out = omega + coupling(in)/counts
+    void drift
+    (
+        Engine & engine,
+        const std::vector<float> & in,
+        std::vector<float> & out,
+        const std::vector<float> & omega,
+        const std::vector<int> & counts,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & blocks
+    )
+    {
+        engine.interaction(in, dtheta, pool, blocks);
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t i = begin; i < end; i++)
+                {
+                    out[i] = omega[i]+(1.0/float(counts[i]))*dtheta[i];
+                    dtheta[i] = 0.0;
+                }
+            }
+        );
+    }
+
+    void euler
+    (
+        Engine & engine,
+        std::vector<float> & theta,
+        const std::vector<float> & omega,
+        const std::vector<int> & counts,
+        const std::vector<float> & noise,
+        float D,
+        double dt,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & blocks
+    )
+    {
+        engine.interaction(theta, dtheta, pool, blocks);
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t i = begin; i < end; i++)
+                {
+                    const float xi = D > 0.0 ? noise[i] : 0.0f;
+                    theta[i] += dt * (omega[i] + xi*D + (1.0/float(counts[i]))*dtheta[i]);
+                    wrap(theta[i]);
+                    dtheta[i] = 0.0;
+                }
+            }
+        );
+    }
+
+    void heun
+    (
+        Engine & engine,
+        std::vector<float> & theta,
+        const std::vector<float> & omega,
+        const std::vector<int> & counts,
+        const std::vector<float> & noise,
+        float D,
+        double dt,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & blocks
+    )
+    {
+        drift(engine, theta, k1, omega, counts, pool, blocks);
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t i = begin; i < end; i++)
+                {
+                    const float xi = D > 0.0 ? noise[i] : 0.0f;
+                    stage[i] = theta[i]+dt*(k1[i]+xi*D);
+                }
+            }
+        );
+        drift(engine, stage, k2, omega, counts, pool, blocks);
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t i = begin; i < end; i++)
+                {
+                    const float xi = D > 0.0 ? noise[i] : 0.0f;
+                    theta[i] += dt*(0.5*(k1[i]+k2[i])+xi*D);
+                    wrap(theta[i]);
+                }
+            }
+        );
+    }
+
+    void rk4
+    (
+        Engine & engine,
+        std::vector<float> & theta,
+        const std::vector<float> & omega,
+        const std::vector<int> & counts,
+        const std::vector<float> & noise,
+        float D,
+        double dt,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & blocks
+    )
+    {
+        // k1 accumulates k1+2k2+2k3 as the stages go, so k3 and k4 can reuse k2
+        auto advance = [&](const std::vector<float> & k, double h)
+        {
+            parallelFor
+            (
+                pool,
+                blocks,
+                [&](uint64_t begin, uint64_t end)
+                {
+                    for (uint64_t i = begin; i < end; i++) { stage[i] = theta[i]+h*k[i]; }
+                }
+            );
+        };
+
+        drift(engine, theta, k1, omega, counts, pool, blocks);
+        advance(k1, 0.5*dt);
+        drift(engine, stage, k2, omega, counts, pool, blocks);
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t i = begin; i < end; i++)
+                {
+                    k1[i] += 2.0f*k2[i];
+                    stage[i] = theta[i]+0.5*dt*k2[i];
+                }
+            }
+        );
+        drift(engine, stage, k2, omega, counts, pool, blocks);
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t i = begin; i < end; i++)
+                {
+                    k1[i] += 2.0f*k2[i];
+                    stage[i] = theta[i]+dt*k2[i];
+                }
+            }
+        );
+        drift(engine, stage, k2, omega, counts, pool, blocks);
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t i = begin; i < end; i++)
+                {
+                    const float xi = D > 0.0 ? noise[i] : 0.0f;
+                    theta[i] += dt*((k1[i]+k2[i])/6.0+xi*D);
+                    wrap(theta[i]);
+                }
+            }
+        );
+    }
+};
+
+#endif /* INTEGRATOR_H */
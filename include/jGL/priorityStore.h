@@ -6,6 +6,10 @@
 #include <iterator>
 #include <algorithm>
 #include <unordered_map>
+#include <map>
+#include <string>
+#include <numeric>
+#include <stdexcept>
 #include <cstdint>
 
 /**
@@ -91,7 +95,7 @@ public:
             []
             (
                 Priority p,
-                std::pair<Info, T> r
+                const std::pair<Info, T> & r
             )
             {
                 return p < r.first.priority;
@@ -100,22 +104,94 @@ public:
         cache.insert(pos, std::pair(Info(id, priority), s));
     }
 
+    /**
+     * @brief Insert many elements with one sort.
+     *
+     * @param elements ids and priorities (as Info) with their elements.
+     * @remark The order is as if each were added in turn, but the new
+     * elements are appended, stably sorted and merged once, O(n log n)
+     * rather than O(n) moves per add.
+     * @remark Throws std::runtime_error if an id already exists (or
+     * repeats), nothing is added then.
+     */
+    void addMany(const std::vector<std::pair<Info, T>> & elements)
+    {
+        for (uint64_t e = 0; e < elements.size(); e++)
+        {
+            const std::pair<Info, T> & element = elements[e];
+            if (!idToElement.emplace(element.first.id, std::pair(element.second, element.first.priority)).second)
+            {
+                for (uint64_t a = 0; a < e; a++) { idToElement.erase(elements[a].first.id); }
+                throw std::runtime_error("id: "+element.first.id+", already use in PriorityStore");
+            }
+        }
+
+        const uint64_t old = cache.size();
+        cache.insert(cache.end(), elements.begin(), elements.end());
+        auto byPriority = [](const std::pair<Info, T> & a, const std::pair<Info, T> & b)
+        {
+            return a.first.priority < b.first.priority;
+        };
+        std::stable_sort(cache.begin()+old, cache.end(), byPriority);
+        std::inplace_merge(cache.begin(), cache.begin()+old, cache.end(), byPriority);
+    }
+
+    /**
+     * @brief Reserve space for elements.
+     *
+     * @param sizeHint reserve this many elements in total.
+     */
+    void reserve(uint64_t sizeHint)
+    {
+        idToElement.reserve(sizeHint);
+        cache.reserve(sizeHint);
+    }
+
+    /**
+     * @brief Remove an element, if its id exists.
+     *
+     * @param id its identity.
+     * @remark The cache is sorted, so only elements of the removed
+     * element's priority are searched.
+     */
     virtual void remove(ElementId id)
     {
-        if (idToElement.find(id) == idToElement.end()) { return; }
+        auto element = idToElement.find(id);
+        if (element == idToElement.end()) { return; }
 
-        idToElement.erase(id);
+        const Priority priority = element->second.second;
+        idToElement.erase(element);
 
-        auto pos = std::find_if
+        auto first = std::lower_bound
         (
             cache.begin(),
             cache.end(),
-            [id](std::pair<Info, T> v)
+            priority,
+            [](const std::pair<Info, T> & r, Priority p)
+            {
+                return r.first.priority < p;
+            }
+        );
+        auto last = std::upper_bound
+        (
+            first,
+            cache.end(),
+            priority,
+            [](Priority p, const std::pair<Info, T> & r)
+            {
+                return p < r.first.priority;
+            }
+        );
+        auto pos = std::find_if
+        (
+            first,
+            last,
+            [&id](const std::pair<Info, T> & v)
             {
                 return v.first.id == id;
             }
         );
-        if (pos != cache.end())
+        if (pos != last)
         {
             cache.erase(pos);
         }
@@ -169,4 +245,218 @@ protected:
     std::vector<std::pair<Info, T>> cache;
 };
 
+/**
+ * @brief A PriorityStore keyed by integer handles instead of strings.
+ *
+ * @tparam T an element.
+ * @remark Elements are dense in one std::vector of the same
+ * std::pair<Info, T> a PriorityStore caches (with empty ids), so a
+ * renderer can draw them directly, see ShapeRenderer::draw.
+ * @remark A handle is a slot index and a generation, the generation
+ * moves on when its element is removed so stale handles are detected.
+ * @remark add, remove and updatePriority are O(1) with no allocation
+ * beyond vector growth. Removal moves the last element into the gap,
+ * if that breaks the priority order ordered() re-sorts (stably) once.
+ */
+template <class T>
+class SlotPriorityStore
+{
+public:
+
+    typedef typename PriorityStore<T>::Info Info;
+
+    /**
+     * @brief Identity of an element in a SlotPriorityStore.
+     *
+     */
+    struct Handle
+    {
+        uint32_t index = UINT32_MAX;
+        uint32_t generation = 0;
+
+        bool operator==(const Handle & h) const { return index == h.index && generation == h.generation; }
+        bool operator!=(const Handle & h) const { return !(*this == h); }
+    };
+
+    /**
+     * @brief Construct a new SlotPriorityStore with a reserved size.
+     *
+     * @param sizeHint reserve this many elements.
+     */
+    SlotPriorityStore(uint64_t sizeHint = 8)
+    {
+        dense.reserve(sizeHint);
+        denseToSlot.reserve(sizeHint);
+        slots.reserve(sizeHint);
+    }
+
+    void clear()
+    {
+        // outstanding handles go stale
+        for (uint64_t d = 0; d < denseToSlot.size(); d++)
+        {
+            release(denseToSlot[d]);
+        }
+        dense.clear();
+        denseToSlot.clear();
+        sorted = true;
+    }
+
+    /**
+     * @brief Insert an element.
+     *
+     * @param s the element.
+     * @param priority its priority.
+     * @return Handle its identity.
+     */
+    Handle add(T s, Priority priority = 0)
+    {
+        uint32_t index;
+        if (free.empty())
+        {
+            index = slots.size();
+            slots.push_back(Slot());
+        }
+        else
+        {
+            index = free.back();
+            free.pop_back();
+        }
+
+        if (!dense.empty() && priority < dense.back().first.priority) { sorted = false; }
+        slots[index].dense = dense.size();
+        dense.push_back(std::pair(Info(ElementId(), priority), s));
+        denseToSlot.push_back(index);
+        return Handle{index, slots[index].generation};
+    }
+
+    /**
+     * @brief Remove an element.
+     *
+     * @param h its handle.
+     * @return true if it was removed, false for a stale handle.
+     */
+    bool remove(Handle h)
+    {
+        if (!valid(h)) { return false; }
+
+        const uint32_t d = slots[h.index].dense;
+        const uint32_t last = dense.size()-1;
+        if (d != last)
+        {
+            dense[d] = std::move(dense[last]);
+            denseToSlot[d] = denseToSlot[last];
+            slots[denseToSlot[d]].dense = d;
+        }
+        dense.pop_back();
+        denseToSlot.pop_back();
+        if (d < dense.size()) { checkOrder(d); }
+        release(h.index);
+        return true;
+    }
+
+    /**
+     * @brief Change the priority of an element, stale handles are ignored.
+     *
+     * @param h its handle.
+     * @param newPriority the priority.
+     */
+    void updatePriority(Handle h, Priority newPriority)
+    {
+        if (!valid(h)) { return; }
+        const uint32_t d = slots[h.index].dense;
+        dense[d].first.priority = newPriority;
+        checkOrder(d);
+    }
+
+    bool valid(Handle h) const
+    {
+        return h.index < slots.size() && slots[h.index].generation == h.generation && slots[h.index].dense != UINT32_MAX;
+    }
+
+    /**
+     * @brief The element of a handle.
+     *
+     * @remark Throws std::runtime_error for a stale handle.
+     */
+    T & operator [](Handle h)
+    {
+        if (!valid(h))
+        {
+            throw std::runtime_error("stale handle: "+std::to_string(h.index)+", in SlotPriorityStore");
+        }
+        return dense[slots[h.index].dense].second;
+    }
+
+    /**
+     * @brief Every element in priority order, equal priorities in no set order.
+     *
+     * @return std::vector<std::pair<Info, T>> & the elements.
+     * @remark Sorts only if an add, remove or updatePriority broke the order.
+     */
+    std::vector<std::pair<Info, T>> & ordered()
+    {
+        if (sorted) { return dense; }
+
+        std::vector<uint32_t> order(dense.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort
+        (
+            order.begin(),
+            order.end(),
+            [this](uint32_t a, uint32_t b) { return dense[a].first.priority < dense[b].first.priority; }
+        );
+
+        std::vector<std::pair<Info, T>> elements;
+        std::vector<uint32_t> owners;
+        elements.reserve(dense.size());
+        owners.reserve(dense.size());
+        for (uint32_t d : order)
+        {
+            slots[denseToSlot[d]].dense = elements.size();
+            elements.push_back(std::move(dense[d]));
+            owners.push_back(denseToSlot[d]);
+        }
+        dense.swap(elements);
+        denseToSlot.swap(owners);
+        sorted = true;
+        return dense;
+    }
+
+    typename std::vector<std::pair<Info, T>>::const_iterator begin() const { return dense.cbegin(); }
+    typename std::vector<std::pair<Info, T>>::const_iterator end() const { return dense.cend(); }
+
+    uint64_t size() const { return dense.size(); }
+
+private:
+
+    struct Slot
+    {
+        // position in dense, UINT32_MAX while free
+        uint32_t dense = UINT32_MAX;
+        uint32_t generation = 0;
+    };
+
+    std::vector<std::pair<Info, T>> dense;
+    std::vector<uint32_t> denseToSlot;
+    std::vector<Slot> slots;
+    std::vector<uint32_t> free;
+    bool sorted = true;
+
+    void release(uint32_t index)
+    {
+        slots[index].dense = UINT32_MAX;
+        slots[index].generation++;
+        free.push_back(index);
+    }
+
+    // whether dense[d] still sits between its neighbours' priorities
+    void checkOrder(uint32_t d)
+    {
+        const Priority p = dense[d].first.priority;
+        if (d > 0 && dense[d-1].first.priority > p) { sorted = false; }
+        if (d+1 < dense.size() && p > dense[d+1].first.priority) { sorted = false; }
+    }
+};
+
 #endif /* PRIORITYSTORE_H */
@@ -135,6 +135,23 @@ namespace jGL
             draw(shader, cache, info);
         }
 
+        /**
+         * @brief Draw the Shapes of a SlotPriorityStore, in its priority order.
+         *
+         * @param shader A Shader to draw all the Shapes with.
+         * @param shapes Shapes keyed by integer handles.
+         * @remark The ShapeRenderer's own (string id) Shapes are not drawn.
+         */
+        void draw
+        (
+            std::shared_ptr<Shader> shader,
+            SlotPriorityStore<Shape> & shapes,
+            UpdateInfo info = UpdateInfo()
+        )
+        {
+            draw(shader, shapes.ordered(), info);
+        }
+
         bool hasId(const ShapeId id) const { return idToElement.find(id) != idToElement.end(); }
 
         virtual void setProjection(glm::mat4 p) {projection = p;}
@@ -96,6 +96,18 @@ namespace jGL
          */
         virtual void draw() { draw(shader, cache); }
 
+        /**
+         * @brief Draw the Sprites of a SlotPriorityStore, in its priority order.
+         *
+         * @param shader A Shader to draw all the Sprites with.
+         * @param sprites Sprites keyed by integer handles.
+         * @remark The SpriteRenderer's own (string id) Sprites are not drawn.
+         */
+        void draw(std::shared_ptr<Shader> shader, SlotPriorityStore<Sprite> & sprites)
+        {
+            draw(shader, sprites.ordered());
+        }
+
         virtual void setProjection(glm::mat4 p) {projection = p;}
 
     protected:
@@ -7,6 +7,12 @@
 #include <queue>
 #include <functional>
 #include <assert.h> 
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 /*
 
@@ -48,8 +54,12 @@
 
     pool.queueJob(std::bind(work,std::ref(a),std::ref(b),std::ref(c2))); - enqueue the function, work, with 3 arguments (as references)
 
+    pool.queueJob(job, i) - enqueue job for thread i (mod size) only, so repeated work lands on the same thread (and its caches, NUMA node)
+
+    pool.pin({c0, c1, ...}) - pin thread i to cpu c_i (mod the list), linux only, returns false if any could not be pinned (or is not a cpu)
+
     pool.wait() - waits until all jobs are done
-    pool.stop() - stops (joins) threads (will interrupt threads if the have not already consumed a job on the queue)
+    pool.stop() - stops (joins) threads (will interrupt threads if the have not already consumed a job on the queue), jobs not started are dropped
 
 */
 namespace jThread
@@ -64,9 +74,10 @@ namespace jThread
       : nThreads(n), terminate(false), working(0)
       {
         threads.resize(n);
+        own.resize(n);
         for (unsigned i = 0; i < n; i++)
         {
-          threads[i] = std::thread(&ThreadPool::main,this);
+          threads[i] = std::thread(&ThreadPool::main,this,i);
         }
       }
 
@@ -81,6 +92,29 @@ namespace jThread
         queueCondition.notify_one();
       }
 
+      void queueJob(const std::function<void(void)> & job, size_t thread)
+      {
+        {
+          std::unique_lock<std::mutex> lock(queueLock);
+          if (own.empty()) { jobs.emplace(job); }
+          else { own[thread % own.size()].emplace(job); }
+          working++;
+        } // release mutex
+        // only the one thread can take it
+        queueCondition.notify_all();
+      }
+
+      bool pin(const std::vector<int> & cpus)
+      {
+        affinity = cpus;
+        bool ok = true;
+        for (unsigned i = 0; i < threads.size(); i++)
+        {
+          ok = applyAffinity(i) && ok;
+        }
+        return ok;
+      }
+
       bool busy()
       {
         bool b = false;
@@ -102,16 +136,11 @@ namespace jThread
 
       void stop()
       {
-        {
-          std::unique_lock<std::mutex> lock(queueLock);
-          terminate = true;
-        } // release mutex
-        queueCondition.notify_all();
-        for (std::thread & t : threads)
-        {
-          t.join();
-        }
-        threads.clear();
+        halt();
+        std::unique_lock<std::mutex> lock(queueLock);
+        // nothing will run them, so nothing to wait for
+        working -= jobs.size();
+        jobs = std::queue<std::function<void(void)>>();
       }
 
       ~ThreadPool()
@@ -125,13 +154,15 @@ namespace jThread
         if (n > 0)
         {
 
-          stop();
+          halt();
           terminate = false;
           threads.resize(n-1);
+          own.resize(n-1);
 
           for (unsigned i = 0; i < n-1; i++)
           {
-            threads[i] = std::thread(&ThreadPool::main,this);
+            threads[i] = std::thread(&ThreadPool::main,this,i);
+            applyAffinity(i);
           }
         }
       }
@@ -149,12 +180,14 @@ namespace jThread
         size_t n = size();
         if (n < nThreads)
         {
-          stop();
+          halt();
           terminate = false;
           threads.resize(n+1);
+          own.resize(n+1);
           for (unsigned i = 0; i < n+1; i++)
           {
-            threads[i] = std::thread(&ThreadPool::main,this);
+            threads[i] = std::thread(&ThreadPool::main,this,i);
+            applyAffinity(i);
           }
         }
       }
@@ -163,7 +196,7 @@ namespace jThread
 
   private:
 
-    void main()
+    void main(size_t index)
     {
       while (true)
       {
@@ -172,7 +205,7 @@ namespace jThread
           std::unique_lock<std::mutex> lock(queueLock);
 
           queueCondition.wait(
-            lock, [this] {return !jobs.empty() || terminate;}
+            lock, [this, index] {return !own[index].empty() || !jobs.empty() || terminate;}
           );
 
           if (terminate)
@@ -180,8 +213,10 @@ namespace jThread
             return;
           }
 
-          job = std::move(jobs.front());
-          jobs.pop();
+          // this thread's own jobs first
+          std::queue<std::function<void(void)>> & queue = own[index].empty() ? jobs : own[index];
+          job = std::move(queue.front());
+          queue.pop();
         } // release mutex
 
         job();
@@ -194,11 +229,52 @@ namespace jThread
       }
     }
 
+    // join the threads, jobs queued for one go back on the shared queue (still counted in working)
+    void halt()
+    {
+      {
+        std::unique_lock<std::mutex> lock(queueLock);
+        terminate = true;
+      } // release mutex
+      queueCondition.notify_all();
+      for (std::thread & t : threads)
+      {
+        t.join();
+      }
+      threads.clear();
+      for (std::queue<std::function<void(void)>> & queue : own)
+      {
+        while (!queue.empty())
+        {
+          jobs.emplace(std::move(queue.front()));
+          queue.pop();
+        }
+      }
+    }
+
     const size_t nThreads;
 
     bool terminate;
 
+    bool applyAffinity(unsigned i)
+    {
+      if (affinity.empty()) { return true; }
+#ifdef __linux__
+      const int cpu = affinity[i % affinity.size()];
+      if (cpu < 0 || cpu >= CPU_SETSIZE) { return false; }
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      return pthread_setaffinity_np(threads[i].native_handle(), sizeof(set), &set) == 0;
+#else
+      return false;
+#endif
+    }
+
     std::queue<std::function<void(void)>> jobs;
+    // per thread queues, see queueJob(job, thread)
+    std::vector<std::queue<std::function<void(void)>>> own;
+    std::vector<int> affinity;
     std::vector<std::thread> threads;
 
     size_t working;
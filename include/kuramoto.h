@@ -0,0 +1,328 @@
+#ifndef KURAMOTO_H
+#define KURAMOTO_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cmath>
+#include <stdexcept>
+
+#include <engine.h>
+#include <simdKernel.h>
+#include <parallel.h>
+
+/*
+    Compressed sparse row coupling matrix.
+
+    The neighbours of oscillator i are indices[offsets[i]] ... indices[offsets[i+1]-1]
+    with coupling strengths weights[offsets[i]] ... weights[offsets[i+1]-1].
+
+    Rows are appended in order, add(j, w) for each neighbour then endRow().
+*/
+struct Coupling
+{
+    std::vector<uint64_t> offsets = {0};
+    std::vector<int> indices;
+    std::vector<float> weights;
+
+    void add(int j, float w)
+    {
+        indices.push_back(j);
+        weights.push_back(w);
+    }
+
+    void endRow() { offsets.push_back(indices.size()); }
+
+    void reserve(uint64_t rows, uint64_t edges)
+    {
+        offsets.reserve(rows+1);
+        indices.reserve(edges);
+        weights.reserve(edges);
+    }
+
+    void shrink()
+    {
+        offsets.shrink_to_fit();
+        indices.shrink_to_fit();
+        weights.shrink_to_fit();
+    }
+
+    void clear()
+    {
+        offsets = {0};
+        indices.clear();
+        weights.clear();
+    }
+
+    uint64_t size() const { return offsets.size()-1; }
+    uint64_t edges() const { return indices.size(); }
+    uint64_t degree(uint64_t i) const { return offsets[i+1]-offsets[i]; }
+
+    /*
+        Whether this is a well formed matrix over columns oscillators,
+        offsets from 0 never decreasing to the edge count, every index
+        in [0, columns) and every weight finite. For data read from disk.
+    */
+    bool valid(uint64_t columns) const
+    {
+        if (offsets.empty() || offsets.front() != 0 || offsets.back() != indices.size() || weights.size() != indices.size())
+        {
+            return false;
+        }
+        for (uint64_t i = 0; i+1 < offsets.size(); i++)
+        {
+            if (offsets[i] > offsets[i+1]) { return false; }
+        }
+        for (uint64_t e = 0; e < indices.size(); e++)
+        {
+            if (indices[e] < 0 || uint64_t(indices[e]) >= columns || !std::isfinite(weights[e])) { return false; }
+        }
+        return true;
+    }
+
+    /*
+        Split the rows into count contiguous blocks of roughly equal work,
+        taking the work of a row as its edges plus one for the update.
+    */
+    std::vector<uint64_t> partition(unsigned count) const
+    {
+        if (count == 0) { count = 1; }
+        std::vector<uint64_t> blocks(count+1, size());
+        blocks[0] = 0;
+        uint64_t work = edges()+size();
+        uint64_t row = 0;
+        for (unsigned b = 1; b < count; b++)
+        {
+            uint64_t target = (work*b)/count;
+            while (row < size() && offsets[row]+row < target) { row++; }
+            blocks[b] = row;
+        }
+        return blocks;
+    }
+
+    uint64_t bytes() const
+    {
+        return offsets.capacity()*sizeof(uint64_t)
+             + indices.capacity()*sizeof(int)
+             + weights.capacity()*sizeof(float);
+    }
+};
+
+/*
+    How Kuramoto::interaction evaluates the kernel.
+
+        STD    std::sin per harmonic per edge.
+        SIMD   polynomial sine over batches of edges, see simdKernel.h.
+        PHASOR per oscillator harmonics e^{i n theta} tabulated once per
+               step, the edge loop is then multiply-adds only.
+*/
+enum class KernelMode { STD, SIMD, PHASOR };
+
+KernelMode kernelModeFromString(std::string mode)
+{
+    if (mode == "std") { return KernelMode::STD; }
+    if (mode == "simd") { return KernelMode::SIMD; }
+    if (mode == "phasor") { return KernelMode::PHASOR; }
+    throw std::runtime_error("Unknown kernel mode: "+mode);
+}
+
+SimdLevel simdLevelFromString(std::string level)
+{
+    if (level == "scalar") { return SimdLevel::NONE; }
+    if (level == "avx2") { return SimdLevel::AVX2; }
+    if (level == "avx512") { return SimdLevel::AVX512; }
+    throw std::runtime_error("Unknown simd level: "+level);
+}
+
+struct Kuramoto : public Engine
+{
+    Coupling K;
+    std::vector<float> expansion_coefficients = {1.0};
+    std::vector<float> shifts = {0.0};
+    KernelMode mode = KernelMode::STD;
+    SimdLevel simd = detectSimdLevel();
+
+    void interaction(const std::vector<float> & theta, std::vector<float> & dtheta)
+    {
+        interaction(theta, dtheta, nullptr, {0, K.size()});
+    }
+
+    std::vector<uint64_t> partition(unsigned count) const { return K.partition(count); }
+
+    uint64_t size() const { return K.size(); }
+
+    uint64_t edges() const { return K.edges(); }
+
+    // accumulate the coupling for all rows, split over blocks
+    void interaction
+    (
+        const std::vector<float> & theta,
+        std::vector<float> & dtheta,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & blocks
+    )
+    {
+        if (mode == KernelMode::PHASOR)
+        {
+            phasors.resize(theta.size()*expansion_coefficients.size()*2);
+            parallelFor
+            (
+                pool,
+                blocks,
+                [&](uint64_t begin, uint64_t end) { tabulatePhasors(theta, begin, end); }
+            );
+        }
+
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end) { interaction(theta, dtheta, begin, end); }
+        );
+    }
+
+    /*
+        Accumulate the coupling for rows [begin, end).
+
+        In PHASOR mode the table must be current for every row, see
+        tabulatePhasors.
+    */
+    void interaction
+    (
+        const std::vector<float> & theta,
+        std::vector<float> & dtheta,
+        uint64_t begin,
+        uint64_t end
+    )
+    {
+        const int * indices = K.indices.data();
+        const float * weights = K.weights.data();
+
+        if (mode == KernelMode::PHASOR)
+        {
+            phasorInteraction(dtheta, begin, end);
+            return;
+        }
+
+        if (mode == KernelMode::SIMD)
+        {
+            KernelRow row = kernelRow(simd);
+            for (uint64_t i = begin; i < end; i++)
+            {
+                uint64_t e = K.offsets[i];
+                dtheta[i] += row
+                (
+                    theta.data(),
+                    indices+e,
+                    weights+e,
+                    K.offsets[i+1]-e,
+                    theta[i],
+                    expansion_coefficients.data(),
+                    shifts.data(),
+                    expansion_coefficients.size()
+                );
+            }
+            return;
+        }
+
+        for (uint64_t i = begin; i < end; i++)
+        {
+            const float ti = theta[i];
+            float d = 0.0;
+            for (uint64_t e = K.offsets[i]; e < K.offsets[i+1]; e++)
+            {
+                d += weights[e]*kernel(theta[indices[e]]-ti);
+            }
+            dtheta[i] += d;
+        }
+    }
+
+    float kernel(float phi) const
+    {
+        float k = 0.0;
+        for (int i = 0; i < expansion_coefficients.size(); i++)
+        {
+            k += expansion_coefficients[i]*std::sin((i+1)*phi+shifts[i]);
+        }
+        return k;
+    }
+
+    /*
+        Fill cos(n theta_j), sin(n theta_j) for oscillators [begin, end)
+        and harmonics n = 1 ... H, interleaved per oscillator so one row
+        gather reads one contiguous run.
+
+        One sin/cos per oscillator, higher harmonics by the angle addition
+        recurrence (in double).
+    */
+    void tabulatePhasors(const std::vector<float> & theta, uint64_t begin, uint64_t end)
+    {
+        const uint64_t h = expansion_coefficients.size();
+        for (uint64_t j = begin; j < end; j++)
+        {
+            const double c1 = std::cos(double(theta[j]));
+            const double s1 = std::sin(double(theta[j]));
+            double c = c1;
+            double s = s1;
+            float * p = &phasors[j*h*2];
+            for (uint64_t n = 0; n < h; n++)
+            {
+                p[2*n] = c;
+                p[2*n+1] = s;
+                double cn = c*c1-s*s1;
+                s = s*c1+c*s1;
+                c = cn;
+            }
+        }
+    }
+
+    /*
+        sum_e w_e sum_n c_n sin(n(theta_j-theta_i)+s_n)
+            = sum_n c_n Im( e^{i(s_n - n theta_i)} sum_e w_e e^{i n theta_j} )
+    */
+    void phasorInteraction(std::vector<float> & dtheta, uint64_t begin, uint64_t end)
+    {
+        const uint64_t h = expansion_coefficients.size();
+        const int * indices = K.indices.data();
+        const float * weights = K.weights.data();
+        const float * table = phasors.data();
+
+        std::vector<float> cs(h), ss(h);
+        for (uint64_t n = 0; n < h; n++)
+        {
+            cs[n] = expansion_coefficients[n]*std::cos(shifts[n]);
+            ss[n] = expansion_coefficients[n]*std::sin(shifts[n]);
+        }
+
+        std::vector<float> sum(h*2);
+        for (uint64_t i = begin; i < end; i++)
+        {
+            std::fill(sum.begin(), sum.end(), 0.0f);
+            for (uint64_t e = K.offsets[i]; e < K.offsets[i+1]; e++)
+            {
+                const float w = weights[e];
+                const float * pj = table+uint64_t(indices[e])*h*2;
+                for (uint64_t n = 0; n < h*2; n++)
+                {
+                    sum[n] += w*pj[n];
+                }
+            }
+
+            const float * pi = table+i*h*2;
+            float d = 0.0;
+            for (uint64_t n = 0; n < h; n++)
+            {
+                // c_n e^{i(s_n - n theta_i)}
+                const float br = cs[n]*pi[2*n]+ss[n]*pi[2*n+1];
+                const float bi = ss[n]*pi[2*n]-cs[n]*pi[2*n+1];
+                d += br*sum[2*n+1]+bi*sum[2*n];
+            }
+            dtheta[i] += d;
+        }
+    }
+
+    // per oscillator harmonics for PHASOR mode
+    std::vector<float> phasors;
+};
+
+#endif /* KURAMOTO_H */
@@ -18,6 +18,23 @@
 #include <sstream>
 
 #include <glCompute.h>
+#include <kuramoto.h>
+#include <meanField.h>
+#include <convolution.h>
+#include <integrator.h>
+#include <fixedPhase.h>
+#include <parallel.h>
+#include <graph.h>
+#include <implicitGraph.h>
+#include <philox.h>
+#include <noise.h>
+#include <checkpoint.h>
+#include <graphCache.h>
+#include <domain.h>
+#include <ensemble.h>
+#include <sweep.h>
+#include <recorder.h>
+#include <colourMap.h>
 
 using namespace std::chrono;
 
@@ -32,6 +49,46 @@ float o = 0.1;
 float kd = 1.0;
 float eta = 0.0;
 float kp = 1.0;
+int threads = 1;
+// cpu per thread, the main thread first then the pool's workers
+std::vector<int> affinity;
+std::string engineType = "graph";
+std::string stencilType = "box";
+Sampler sampler = Sampler::BOX;
+Scheme scheme = Scheme::EULER;
+double dt = 1.0/60.0;
+std::string phaseType = "float";
+// "field" draws one texture, "shapes" one jGL::Shape per oscillator
+std::string viewType = "field";
+KernelMode kernelMode = KernelMode::STD;
+SimdLevel simdLevel = detectSimdLevel();
+// seeds the graph, initial conditions and noise, -seed repeats a run
+uint64_t seed = std::random_device()();
+bool seedGiven = false;
+// steps to run without a display, 0 opens the window
+uint64_t headless = 0;
+// processes to split a headless run over, in strips of rows
+int ranks = 1;
+// replicas of a headless ensemble run (0 for none), each list entry
+// overrides seed+r, k, o and eta for replica r
+unsigned replicas = 0;
+std::vector<uint64_t> replicaSeeds;
+std::vector<float> replicaK, replicaO, replicaEta;
+// a headless sweep of threads concurrent runs, see sweep.h, resumed from sweepOut
+std::string sweepSpec = "";
+uint64_t sweepSamples = 0;
+uint64_t sweepEvery = 10;
+std::string sweepOut = "sweep.jsonl";
+// written every checkpointEvery steps (if > 0) and at exit
+std::string checkpointPath = "";
+uint64_t checkpointEvery = 0;
+std::string restorePath = "";
+// stored graphs kept between runs, bounded to graphCacheSize MB
+std::string graphCachePath = "";
+uint64_t graphCacheSize = 1024;
+// theta every recordEvery steps, compressed in the background
+std::string recordPath = "";
+uint64_t recordEvery = 1;
 
 std::vector<float> coef = {1.0};
 std::vector<float> shifts = {0.0};
@@ -63,6 +120,248 @@ std::string fixedLengthNumber(double x, unsigned length)
     return dtrunc;
 }
 
+/*
+    A headless run of the stored graph engine split over ranks forked
+    processes, each stepping a strip of rows and swapping shells wide
+    halos with its neighbours every evaluation. Rank 0 gathers theta
+    and prints the stats. The graph, initial conditions and noise are
+    drawn for the strip's global indices, so the result matches a
+    single process run of the same seed.
+*/
+int headlessRanks()
+{
+#ifdef WINDOWS
+    throw std::runtime_error("-ranks needs fork and Unix sockets");
+#else
+    if (engineType != "graph" || phaseType != "float" || checkpointPath != "" || restorePath != "" || recordPath != "" || replicas > 0 || sweepSpec != "")
+    {
+        throw std::runtime_error("-ranks needs -engine graph, -phase float and no checkpoint, restore, record, replicas or sweep");
+    }
+
+    DomainKuramoto::check(cells, shells, ranks);
+    std::unique_ptr<SocketTransport> transport = forkRanks(ranks);
+    const bool root = transport->rank() == 0;
+
+    std::unique_ptr<jThread::ThreadPool> pool;
+    if (threads > 1)
+    {
+        pool = std::make_unique<jThread::ThreadPool>(threads-1);
+    }
+
+    HashedGraph graph;
+    graph.seed = seed;
+    graph.cells = cells;
+    graph.shells = shells;
+    graph.k = k;
+    graph.kp = kp;
+    graph.kd = kd;
+    graph.sampler = sampler;
+
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+    std::vector<int> counts;
+    DomainKuramoto domain(graph, *transport, counts, pool.get(), threads);
+    domain.local.expansion_coefficients = coef;
+    domain.local.shifts = shifts;
+    domain.local.mode = kernelMode;
+    domain.local.simd = simdLevel;
+    const double graphTime = duration_cast<duration<double>>(high_resolution_clock::now()-start).count();
+
+    const uint64_t n = domain.size();
+    std::vector<float> omega(n), theta(n);
+    Philox initial(seed, 0);
+    initial.uniform(0, domain.begin(), domain.begin()+n, omega.data());
+    initial.uniform(1, domain.begin(), domain.begin()+n, theta.data());
+    for (uint64_t i = 0; i < n; i++)
+    {
+        omega[i] *= o;
+        theta[i] *= 2.0*3.14159;
+    }
+
+    const std::vector<uint64_t> blocks = domain.partition(threads);
+    float D = std::sqrt(2.0*eta*1.0/dt);
+    Integrator integrator(scheme);
+    std::unique_ptr<NoiseStage> noiseStage;
+    if (D > 0.0)
+    {
+        noiseStage = std::make_unique<NoiseStage>(n, seed, 1, 0, domain.begin());
+    }
+    const std::vector<float> none;
+
+    start = high_resolution_clock::now();
+    for (uint64_t s = 0; s < headless; s++)
+    {
+        const std::vector<float> & noise = noiseStage ? noiseStage->next() : none;
+        integrator.step(domain, theta, omega, counts, noise, D, dt, pool.get(), blocks);
+    }
+    const double wall = duration_cast<duration<double>>(high_resolution_clock::now()-start).count();
+
+    std::vector<float> all;
+    domain.gather(theta, all);
+    const uint64_t edges = domain.sum(domain.edges());
+    if (root)
+    {
+        std::cout << "Seed: " << seed << "\n"
+                  << "Ranks: " << ranks
+                  << ", steps: " << headless
+                  << ", wall time: " << wall << " s"
+                  << ", steps/s: " << double(headless)/wall
+                  << ", edges/s: " << double(headless)*integrator.evaluations()*double(edges)/wall
+                  << ", r: " << orderParameter(all)
+                  << ", graph: " << graphTime << " s\n";
+    }
+    // the other ranks return from main too, rank 0's transport waits for them
+    return 0;
+#endif
+}
+
+/*
+    A headless run of replicas copies of the stored graph model, all
+    stepped in one pass over the graph (see ensemble.h). The graph is
+    drawn from -seed, replica r's initial conditions and noise from its
+    own seed. Prints each replica's order parameter.
+*/
+int headlessEnsemble()
+{
+    if (engineType != "graph" || phaseType != "float" || scheme != Scheme::EULER || checkpointPath != "" || restorePath != "" || recordPath != "" || sweepSpec != "")
+    {
+        throw std::runtime_error("-replicas needs -engine graph, -phase float, -integrator euler and no checkpoint, restore, record or sweep");
+    }
+
+    std::vector<Replica> ensemble(replicas);
+    for (unsigned r = 0; r < replicas; r++)
+    {
+        ensemble[r].seed = r < replicaSeeds.size() ? replicaSeeds[r] : seed+r;
+        ensemble[r].k = r < replicaK.size() ? replicaK[r] : k;
+        ensemble[r].o = r < replicaO.size() ? replicaO[r] : o;
+        ensemble[r].eta = r < replicaEta.size() ? replicaEta[r] : eta;
+    }
+
+    std::unique_ptr<jThread::ThreadPool> pool;
+    if (threads > 1)
+    {
+        pool = std::make_unique<jThread::ThreadPool>(threads-1);
+    }
+
+    // unit k, each replica scales the weights by its own
+    HashedGraph graph;
+    graph.seed = seed;
+    graph.cells = cells;
+    graph.shells = shells;
+    graph.k = 1.0;
+    graph.kp = kp;
+    graph.kd = kd;
+    graph.sampler = sampler;
+
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+    Coupling K;
+    std::vector<int> counts;
+    buildGraph(K, counts, graph, pool.get(), evenBlocks(graph.size(), threads));
+    const double graphTime = duration_cast<duration<double>>(high_resolution_clock::now()-start).count();
+
+    Ensemble model(std::move(K), counts, ensemble, coef, shifts, kernelMode, simdLevel);
+    const std::vector<uint64_t> blocks = model.partition(threads);
+    if (kernelMode == KernelMode::SIMD)
+    {
+        std::cout << "SIMD kernel: " << simdLevelName(simdLevel) << "\n";
+    }
+
+    start = high_resolution_clock::now();
+    for (uint64_t s = 0; s < headless; s++)
+    {
+        model.step(dt, pool.get(), blocks);
+    }
+    const double wall = duration_cast<duration<double>>(high_resolution_clock::now()-start).count();
+
+    std::cout << "Replicas: " << replicas
+              << ", steps: " << headless
+              << ", wall time: " << wall << " s"
+              << ", steps/s: " << double(headless)/wall
+              << ", replica edges/s: " << double(headless)*double(replicas)*double(model.edges())/wall
+              << ", graph: " << graphTime << " s\n";
+    const std::vector<double> order = model.orderParameters();
+    for (unsigned r = 0; r < replicas; r++)
+    {
+        std::cout << "Replica " << r
+                  << ", seed: " << ensemble[r].seed
+                  << ", k: " << ensemble[r].k
+                  << ", o: " << ensemble[r].o
+                  << ", eta: " << ensemble[r].eta
+                  << ", r: " << order[r] << "\n";
+    }
+    return 0;
+}
+
+/*
+    A headless sweep over sweepSpec (a grid, or sweepSamples random
+    draws seeded by -seed), threads runs at a time of headless steps
+    each. The other parameters are every run's defaults, all of them
+    and the spec are the header of sweepOut so a resume only continues
+    the same sweep.
+*/
+int headlessSweep()
+{
+    if (engineType != "graph" || phaseType != "float" || checkpointPath != "" || restorePath != "" || recordPath != "" || replicas > 0)
+    {
+        throw std::runtime_error("-sweep needs -engine graph, -phase float and no checkpoint, restore, record or replicas");
+    }
+
+    // a resumed sweep without -seed keeps the seed its results were made with
+    if (!seedGiven) { Sweep::previousSeed(sweepOut, seed); }
+
+    SweepRun defaults;
+    defaults.cells = cells;
+    defaults.shells = shells;
+    defaults.k = k;
+    defaults.kd = kd;
+    defaults.o = o;
+    defaults.eta = eta;
+    defaults.kp = kp;
+    defaults.seed = seed;
+    defaults.coef = coef;
+    defaults.shifts = shifts;
+    SweepSpec spec(sweepSpec, defaults, sweepSamples, seed);
+
+    std::stringstream header;
+    header << "{\"sweep\": \"" << sweepSpec << "\""
+           << ", \"samples\": " << sweepSamples
+           << ", \"seed\": " << seed
+           << ", \"steps\": " << headless
+           << ", \"every\": " << sweepEvery
+           << ", \"dt\": " << dt
+           << ", \"integrator\": " << int(scheme)
+           << ", \"sampler\": " << int(sampler)
+           << ", \"cells\": " << cells
+           << ", \"shells\": " << shells
+           << ", \"k\": " << k
+           << ", \"kd\": " << kd
+           << ", \"o\": " << o
+           << ", \"eta\": " << eta
+           << ", \"kp\": " << kp;
+    header << ", \"coef\": [";
+    for (uint64_t i = 0; i < coef.size(); i++) { header << (i > 0 ? ", " : "") << coef[i]; }
+    header << "], \"shifts\": [";
+    for (uint64_t i = 0; i < shifts.size(); i++) { header << (i > 0 ? ", " : "") << shifts[i]; }
+    header << "]}";
+
+    Sweep sweep(spec, header.str(), sweepOut, headless, sweepEvery, dt, scheme, sampler, kernelMode, simdLevel);
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+    sweep.run(threads);
+    const double wall = duration_cast<duration<double>>(high_resolution_clock::now()-start).count();
+
+    std::cout << "Sweep: " << spec.size() << " runs"
+              << ", resumed: " << sweep.resumed()
+              << ", finished: " << sweep.finished()
+              << ", failed: " << spec.size()-sweep.resumed()-sweep.finished()
+              << ", wall time: " << wall << " s"
+              << ", results: " << sweepOut << "\n";
+    return 0;
+}
+
+/*
+    A texture of phases on a quad over [0, 1]^2, coloured by cmap in
+    the fragment shader. draw() fills the screen, draw(projection) puts
+    the quad in the world.
+*/
 struct Visualise
 {
     Visualise(GLuint texture)
@@ -96,11 +395,23 @@ struct Visualise
         glBindVertexArray(0);
     }
 
-    void draw()
+    ~Visualise()
+    {
+        glDeleteBuffers(1, &vbo);
+        glDeleteVertexArrays(1, &vao);
+    }
+
+    Visualise(const Visualise &) = delete;
+    Visualise & operator=(const Visualise &) = delete;
+
+    void draw() { draw(glm::ortho(0.0f, 1.0f, 0.0f, 1.0f)); }
+
+    void draw(const glm::mat4 & projection)
     {
         glActiveTexture(GL_TEXTURE1);
         glBindTexture(GL_TEXTURE_2D, texture);
         shader.setUniform("tex", jGL::Sampler2D(1));
+        shader.setUniform("proj", projection);
 
         glBindVertexArray(vao);
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -110,23 +421,25 @@ struct Visualise
 
     jGL::GL::glShader shader;
     GLuint texture, vao, vbo;
+    // world position, texture coordinates
     float quad[6*4] =
     {
-        -1.0, -1.0, 0.0, 0.0,
-         1.0, -1.0, 1.0, 0.0,
-         1.0,  1.0, 1.0, 1.0,
-        -1.0, -1.0, 0.0, 0.0,
-        -1.0,  1.0, 0.0, 1.0,
-         1.0,  1.0, 1.0, 1.0
+        0.0, 0.0, 0.0, 0.0,
+        1.0, 0.0, 1.0, 0.0,
+        1.0, 1.0, 1.0, 1.0,
+        0.0, 0.0, 0.0, 0.0,
+        0.0, 1.0, 0.0, 1.0,
+        1.0, 1.0, 1.0, 1.0
     };
     const char * vertexShader =
     "#version " GLSL_VERSION "\n"
     "precision highp float;\n"
     "precision highp int;\n"
     "layout(location = 0) in vec4 a_position;\n"
+    "uniform mat4 proj;\n"
     "out vec2 o_texCoords;\n"
     "void main(){\n"
-    "   gl_Position = vec4(a_position.xy,0.0,1.0);\n"
+    "   gl_Position = proj*vec4(a_position.xy,0.0,1.0);\n"
     "   o_texCoords = a_position.zw;\n"
     "}";
 
@@ -151,34 +464,44 @@ struct Visualise
     "}";
 };
 
-struct Kuramoto
+/*
+    The oscillators as one cells x cells R32F texture of phases, drawn
+    by Visualise with the camera's projection. The quad covers the
+    world square [0, 1]^2, where the shape view puts them, so zoom and
+    pan still apply.
+
+    Each upload is 4 bytes an oscillator into the texture allocated
+    once. The shape view keeps a Transform, colour and Shape per
+    oscillator and sends 36 bytes of instance attributes for each.
+*/
+struct FieldView : public Visualise
 {
-    std::vector<std::vector<std::pair<int, float>>> K;
-    std::vector<float> expansion_coefficients = {1.0};
-    std::vector<float> shifts = {0.0};
+    FieldView(int cells)
+    : Visualise(phaseTexture(cells)), cells(cells)
+    {}
 
-    std::vector<float> interaction(std::vector<float> & theta, std::vector<float> & dtheta)
+    ~FieldView()
     {
-        for (int i = 0; i < K.size(); i++)
-        {
-            for (auto & jk : K[i])
-            {
-                dtheta[i] += jk.second*kernel(theta[jk.first]-theta[i]);
-            }
-        }
+        glDeleteTextures(1, &texture);
+    }
 
-        return dtheta;
+    // phases in radians, cells*cells of them row by row
+    void upload(const std::vector<float> & theta)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, cells, cells, GL_RED, GL_FLOAT, theta.data());
     }
 
-    float kernel(float phi)
+    static GLuint phaseTexture(int cells)
     {
-        float k = 0.0;
-        for (int i = 0; i < expansion_coefficients.size(); i++)
-        {
-            k += expansion_coefficients[i]*std::sin((i+1)*phi+shifts[i]);
-        }
-        return k;
+        GLuint texture;
+        glGenTextures(1, &texture);
+        initTexture2DR32F(texture, cells, cells);
+        return texture;
     }
+
+    int cells;
 };
 
 const char * kuramotoComputeShader =
@@ -249,37 +572,4 @@ const char * kuramotoComputeShader =
     "    output = ijtheta+dt*(omega+D*diff+dtheta/count);\n"
     "}";
 
-float clamp(float x, float low, float high)
-{
-    return std::min(std::max(x, low), high);
-}
-
-float poly(float x, float p0, float p1, float p2, float p3, float p4)
-{
-   float x2 = x*x; float x4 = x2*x2; float x3 = x2*x;
-   return clamp(p0+p1*x+p2*x2+p3*x3+p4*x4,0.0,1.0);
-}
-
-glm::vec3 cmap(float t)
-{
-    return glm::vec3( poly(t,0.91, 3.74, -32.33, 57.57, -28.99), poly(t,0.2, 5.6, -18.89, 25.55, -12.25), poly(t,0.22, -4.89, 22.31, -23.58, 5.97) );
-}
-
-std::vector<std::pair<int, int>> shell(int i, int j, int s, int l)
-{
-    std::vector<std::pair<int, int>> indices;
-    for (int n = -s; n <= s; n++)
-    {
-        for (int m = -s; m <= s; m++)
-        {
-            int ix = n+i % l;
-            int iy = m+j % l;
-            if (ix < 0) { ix += l; }
-            if (iy < 0) { iy += l; }
-            indices.push_back({ix, iy});
-        }
-    }
-    return indices;
-}
-
 #endif /* MAIN_H */
@@ -0,0 +1,149 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+
+#ifndef WINDOWS
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+    A whole file, read only, mapped for as long as this lives. Windows
+    reads it into a buffer instead. Throws if it cannot be opened.
+*/
+class MappedFile
+{
+
+public:
+
+    MappedFile(std::string path)
+    {
+#ifndef WINDOWS
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Could not open "+path);
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Could not stat "+path);
+        }
+        length = info.st_size;
+        if (length > 0)
+        {
+            map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (map == MAP_FAILED)
+        {
+            throw std::runtime_error("Could not map "+path);
+        }
+        if (length > 0)
+        {
+            madvise(map, length, MADV_SEQUENTIAL);
+        }
+        bytes = static_cast<const char *>(map);
+#else
+        FILE * file = std::fopen(path.c_str(), "rb");
+        if (file == nullptr)
+        {
+            throw std::runtime_error("Could not open "+path);
+        }
+        std::fseek(file, 0, SEEK_END);
+        length = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        buffer.resize(length);
+        const bool read = std::fread(buffer.data(), 1, length, file) == length;
+        std::fclose(file);
+        if (!read)
+        {
+            throw std::runtime_error("Could not read "+path);
+        }
+        bytes = buffer.data();
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifndef WINDOWS
+        if (map != nullptr && map != MAP_FAILED)
+        {
+            munmap(map, length);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    const char * data() const { return bytes; }
+    uint64_t size() const { return length; }
+
+    // count Ts at byte offset into v
+    template <class T>
+    void copy(std::vector<T> & v, uint64_t offset, uint64_t count) const
+    {
+        const T * p = reinterpret_cast<const T *>(bytes+offset);
+        v.assign(p, p+count);
+    }
+
+private:
+
+    uint64_t length = 0;
+    const char * bytes = nullptr;
+#ifndef WINDOWS
+    void * map = nullptr;
+#else
+    std::vector<char> buffer;
+#endif
+};
+
+/*
+    The write side, sections at byte offsets of a new file with zeros
+    in any gap before each. ok() is false from the first failed write.
+*/
+class SectionWriter
+{
+
+public:
+
+    SectionWriter(FILE * file)
+    : file(file)
+    {}
+
+    void section(uint64_t offset, const void * data, uint64_t bytes)
+    {
+        static const char zeros[64] = {0};
+        while (good && at < offset)
+        {
+            uint64_t pad = std::min(offset-at, uint64_t(sizeof(zeros)));
+            good = std::fwrite(zeros, 1, pad, file) == pad;
+            at += pad;
+        }
+        if (good && bytes > 0)
+        {
+            good = std::fwrite(data, 1, bytes, file) == bytes;
+            at += bytes;
+        }
+    }
+
+    bool ok() const { return good; }
+
+private:
+
+    FILE * file;
+    uint64_t at = 0;
+    bool good = true;
+};
+
+#endif /* MAPPEDFILE_H */
@@ -0,0 +1,139 @@
+#ifndef MEANFIELD_H
+#define MEANFIELD_H
+
+#include <engine.h>
+#include <parallel.h>
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+
+/*
+    All-to-all coupling with uniform strength k.
+
+    sum_j k kernel(theta_j-theta_i)
+        = k sum_n c_n Im( e^{i(s_n - n theta_i)} Z_n ),  Z_n = sum_j e^{i n theta_j}
+
+    so each step is one reduction for the order parameters Z_n followed
+    by an O(N) update, no coupling matrix is stored. The j = i term is
+    included, as it is for the self edge of the graph engine, so the
+    caller should normalise by N.
+
+    The reduction is per block in double then summed in block order, so
+    it is deterministic for a given block count.
+*/
+struct MeanField : public Engine
+{
+    uint64_t n = 0;
+    float k = 1.0;
+    std::vector<float> expansion_coefficients = {1.0};
+    std::vector<float> shifts = {0.0};
+
+    std::vector<uint64_t> partition(unsigned count) const { return evenBlocks(n, count); }
+
+    uint64_t size() const { return n; }
+
+    uint64_t edges() const { return n*n; }
+
+    void interaction
+    (
+        const std::vector<float> & theta,
+        std::vector<float> & dtheta,
+        jThread::ThreadPool * pool,
+        const std::vector<uint64_t> & blocks
+    )
+    {
+        const uint64_t h = expansion_coefficients.size();
+        const uint64_t nBlocks = blocks.size()-1;
+
+        partial.assign(nBlocks*h*2, 0.0);
+        std::vector<uint64_t> blockIds(nBlocks+1);
+        for (uint64_t b = 0; b <= nBlocks; b++) { blockIds[b] = b; }
+
+        parallelFor
+        (
+            pool,
+            blockIds,
+            [&](uint64_t b, uint64_t)
+            {
+                double * z = &partial[b*h*2];
+                for (uint64_t j = blocks[b]; j < blocks[b+1]; j++)
+                {
+                    const double c1 = std::cos(double(theta[j]));
+                    const double s1 = std::sin(double(theta[j]));
+                    double c = c1;
+                    double s = s1;
+                    for (uint64_t m = 0; m < h; m++)
+                    {
+                        z[2*m] += c;
+                        z[2*m+1] += s;
+                        double cm = c*c1-s*s1;
+                        s = s*c1+c*s1;
+                        c = cm;
+                    }
+                }
+            }
+        );
+
+        Z.assign(h*2, 0.0);
+        for (uint64_t b = 0; b < nBlocks; b++)
+        {
+            for (uint64_t m = 0; m < h*2; m++)
+            {
+                Z[m] += partial[b*h*2+m];
+            }
+        }
+
+        // k c_n e^{i s_n} Z_n, then each oscillator only rotates by -n theta_i
+        std::vector<double> a(h*2);
+        for (uint64_t m = 0; m < h; m++)
+        {
+            const double cr = k*expansion_coefficients[m]*std::cos(double(shifts[m]));
+            const double ci = k*expansion_coefficients[m]*std::sin(double(shifts[m]));
+            a[2*m] = cr*Z[2*m]-ci*Z[2*m+1];
+            a[2*m+1] = cr*Z[2*m+1]+ci*Z[2*m];
+        }
+
+        parallelFor
+        (
+            pool,
+            blocks,
+            [&](uint64_t begin, uint64_t end)
+            {
+                for (uint64_t i = begin; i < end; i++)
+                {
+                    const double c1 = std::cos(double(theta[i]));
+                    const double s1 = std::sin(double(theta[i]));
+                    double c = c1;
+                    double s = s1;
+                    double d = 0.0;
+                    for (uint64_t m = 0; m < h; m++)
+                    {
+                        // Im( (c - i s) (a_r + i a_i) )
+                        d += c*a[2*m+1]-s*a[2*m];
+                        double cm = c*c1-s*s1;
+                        s = s*c1+c*s1;
+                        c = cm;
+                    }
+                    dtheta[i] += d;
+                }
+            }
+        );
+    }
+
+    // |Z_1|/N from the last interaction
+    double orderParameter() const
+    {
+        if (Z.size() < 2 || n == 0) { return 0.0; }
+        return std::sqrt(Z[0]*Z[0]+Z[1]*Z[1])/double(n);
+    }
+
+    // per harmonic sum_j e^{i n theta_j}, (re, im) interleaved
+    std::vector<double> Z;
+
+private:
+
+    std::vector<double> partial;
+};
+
+#endif /* MEANFIELD_H */
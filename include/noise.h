@@ -0,0 +1,66 @@
+#ifndef NOISE_H
+#define NOISE_H
+
+#include <philox.h>
+#include <jThread/jThread.h>
+
+#include <vector>
+#include <cstdint>
+
+/*
+    Per step standard normal noise, one value per oscillator.
+
+    Buffers are filled in bulk by Philox::normal on a thread of their
+    own, one step ahead, so the fill overlaps the coupling evaluation of
+    the current step. Step s always gets Philox(seed, stream) counter
+    step s, so the noise is the same as filling it in place.
+
+    The buffer holds oscillators offset ... offset+n-1, for a rank that
+    only steps part of the lattice.
+
+    Only construct one when the noise amplitude is non zero, otherwise
+    there is nothing to draw.
+*/
+class NoiseStage
+{
+
+public:
+
+    NoiseStage(uint64_t n, uint64_t seed, uint32_t stream, uint64_t step = 0, uint64_t offset = 0)
+    : rng(seed, stream), front(n, 0.0f), back(n, 0.0f), filling(step), offset(offset), worker(1)
+    {
+        queue();
+    }
+
+    ~NoiseStage()
+    {
+        worker.wait();
+    }
+
+    // this step's noise, valid until the next call
+    const std::vector<float> & next()
+    {
+        worker.wait();
+        front.swap(back);
+        filling++;
+        queue();
+        return front;
+    }
+
+private:
+
+    Philox rng;
+    std::vector<float> front, back;
+    uint64_t filling;
+    uint64_t offset;
+    // declared last so it is joined before the buffers go
+    jThread::ThreadPool worker;
+
+    void queue()
+    {
+        const uint64_t step = filling;
+        worker.queueJob([this, step]() { rng.normal(step, offset, offset+back.size(), back.data()); });
+    }
+};
+
+#endif /* NOISE_H */
@@ -0,0 +1,142 @@
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <parallel.h>
+#include <jThread/jThread.h>
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*
+    NUMA placement without libnuma.
+
+    Linux puts a page on the node of the thread that first touches it,
+    and everything here is allocated (so touched) on the main thread.
+    placePages drops the pages of a vector and writes its contents back
+    block by block through parallelFor, which sends block b to the same
+    worker every call, so each block's pages end up on the node of the
+    thread that steps it. Pinning (-affinity) keeps the threads there.
+*/
+
+// "0-3,8,10-11" to {0, 1, 2, 3, 8, 10, 11}
+std::vector<int> cpuList(std::string list)
+{
+    std::vector<int> cpus;
+    std::stringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ','))
+    {
+        if (range.find_first_of("0123456789") == std::string::npos) { continue; }
+        const uint64_t dash = range.find('-');
+        const int first = std::stoi(range.substr(0, dash));
+        const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash+1));
+        for (int c = first; c <= last; c++) { cpus.push_back(c); }
+    }
+    return cpus;
+}
+
+// whether cpu is one the kernel has online (any it was built for if sysfs says nothing)
+bool cpuOnline(int cpu)
+{
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) { return false; }
+    std::ifstream in("/sys/devices/system/cpu/online");
+    std::string list;
+    if (!in || !std::getline(in, list)) { return cpu < sysconf(_SC_NPROCESSORS_CONF); }
+    const std::vector<int> online = cpuList(list);
+    return std::find(online.begin(), online.end(), cpu) != online.end();
+#else
+    return false;
+#endif
+}
+
+// pin the calling thread to cpu, false if it could not be (not an online cpu, or not linux)
+bool pinCurrentThread(int cpu)
+{
+#ifdef __linux__
+    if (!cpuOnline(cpu)) { return false; }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+// cpus of each NUMA node, one node of every cpu if sysfs says nothing
+std::vector<std::vector<int>> numaNodes()
+{
+    std::vector<std::vector<int>> nodes;
+    for (int node = 0; ; node++)
+    {
+        std::ifstream in("/sys/devices/system/node/node"+std::to_string(node)+"/cpulist");
+        if (!in) { break; }
+        std::string list;
+        std::getline(in, list);
+        nodes.push_back(cpuList(list));
+    }
+    if (nodes.empty())
+    {
+        std::vector<int> all(std::max(std::thread::hardware_concurrency(), 1u));
+        for (uint64_t c = 0; c < all.size(); c++) { all[c] = c; }
+        nodes.push_back(all);
+    }
+    return nodes;
+}
+
+/*
+    Re-place v so elements [blocks[b], blocks[b+1]) are first touched by
+    the thread parallelFor runs block b on, anything outside the blocks
+    by the caller. Contents are kept. Does nothing off linux, without a
+    pool, or for under a few pages.
+*/
+template <class T>
+void placePages
+(
+    std::vector<T> & v,
+    jThread::ThreadPool * pool,
+    const std::vector<uint64_t> & blocks
+)
+{
+#ifdef __linux__
+    const uint64_t page = sysconf(_SC_PAGESIZE);
+    const uint64_t bytes = v.size()*sizeof(T);
+    if (pool == nullptr || pool->size() == 0 || blocks.size() < 2 || bytes < 4*page) { return; }
+
+    // whole pages inside the buffer, anonymous memory refaults them as zeros
+    const uintptr_t start = (reinterpret_cast<uintptr_t>(v.data())+page-1)/page*page;
+    const uintptr_t stop = (reinterpret_cast<uintptr_t>(v.data())+bytes)/page*page;
+    const std::vector<T> contents(v);
+    if (madvise(reinterpret_cast<void *>(start), stop-start, MADV_DONTNEED) != 0) { return; }
+
+    parallelFor
+    (
+        pool,
+        blocks,
+        [&](uint64_t begin, uint64_t end)
+        {
+            std::copy(contents.begin()+begin, contents.begin()+end, v.begin()+begin);
+        }
+    );
+    // anything the blocks do not cover
+    const uint64_t first = std::min(uint64_t(blocks.front()), uint64_t(v.size()));
+    const uint64_t last = std::min(uint64_t(blocks.back()), uint64_t(v.size()));
+    std::copy(contents.begin(), contents.begin()+first, v.begin());
+    std::copy(contents.begin()+last, contents.end(), v.begin()+last);
+#endif
+}
+
+#endif /* NUMA_H */
@@ -0,0 +1,72 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <jThread/jThread.h>
+
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+/*
+    Run job(begin, end) for each block [blocks[b], blocks[b+1]).
+
+    With a pool all but the last block are queued and the last runs on
+    the calling thread, so a pool of n-1 workers keeps n cores busy.
+    With at most one queued block a worker, block b always goes to
+    worker b, so a block's rows stay in one core's cache and on the NUMA
+    node its pages were first touched from, see numa.h. With more,
+    blocks go to the shared queue and any idle worker takes them, the
+    pinning (and page placement) is lost but no worker runs several
+    blocks while others wait. Returns once every block is done.
+*/
+void parallelFor
+(
+    jThread::ThreadPool * pool,
+    const std::vector<uint64_t> & blocks,
+    const std::function<void(uint64_t, uint64_t)> & job
+)
+{
+    if (blocks.size() < 2) { return; }
+
+    uint64_t last = blocks.size()-2;
+
+    if (pool == nullptr || pool->size() == 0)
+    {
+        for (uint64_t b = 0; b <= last; b++)
+        {
+            job(blocks[b], blocks[b+1]);
+        }
+        return;
+    }
+
+    const bool pinned = last <= pool->size();
+    for (uint64_t b = 0; b < last; b++)
+    {
+        uint64_t begin = blocks[b];
+        uint64_t end = blocks[b+1];
+        if (pinned)
+        {
+            pool->queueJob([&job, begin, end]() { job(begin, end); }, b);
+        }
+        else
+        {
+            pool->queueJob([&job, begin, end]() { job(begin, end); });
+        }
+    }
+    job(blocks[last], blocks[last+1]);
+    pool->wait();
+}
+
+// split [0, n) into count blocks of (nearly) equal length
+std::vector<uint64_t> evenBlocks(uint64_t n, unsigned count)
+{
+    if (count == 0) { count = 1; }
+    std::vector<uint64_t> blocks(count+1, n);
+    for (unsigned b = 0; b < count; b++)
+    {
+        blocks[b] = (n*b)/count;
+    }
+    return blocks;
+}
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,310 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <simdKernel.h>
+
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <cmath>
+#include <string>
+#include <stdexcept>
+
+/*
+    Counter based random numbers, Philox4x32-10 (Salmon et al. 2011,
+    "Parallel random numbers: as easy as 1, 2, 3").
+
+    Every draw is a pure function of (seed, stream, step, index), so any
+    thread, in any order, can fill any part of a buffer and get the same
+    numbers. There is no state to share or advance.
+
+    The 128 bit counter is (index, step, stream) and the key is the seed.
+    Streams keep unrelated uses of one seed apart (initial conditions,
+    noise). The step is 64 bits, its low word is the step word and its
+    high 16 bits share the last word with the stream (below 2^16), so
+    steps under 2^32 draw as they always have and no step repeats
+    another before 2^48. One block gives four values, so index i is served by counter
+    i/4.
+
+    Normals use Box-Muller with the polynomial log and sine of
+    simdKernel.h. On AVX2 cpus bulk fills run PHILOX_LANES counters at a
+    time in vector registers. The vector path does the same float
+    operations in the same order (no FMA), so it rounds identically and
+    the numbers do not depend on how a buffer is split.
+*/
+
+const uint64_t PHILOX_LANES = 8;
+
+namespace philoxConstants
+{
+    const uint32_t M0 = 0xD2511F53;
+    const uint32_t M1 = 0xCD9E8D57;
+    const uint32_t W0 = 0x9E3779B9;
+    const uint32_t W1 = 0xBB67AE85;
+    const float TWO_PI = 6.28318530717958648f;
+    const float HALF_PI = 1.57079632679489662f;
+}
+
+const uint32_t PHILOX_STREAMS = 1u << 16;
+
+// the last counter word, the stream and the step's high bits
+inline uint32_t philoxStreamWord(uint32_t stream, uint64_t step)
+{
+    return stream | (uint32_t(step >> 32) << 16);
+}
+
+// 24 bits to [0, 1)
+inline float philoxFloat(uint32_t x)
+{
+    return float(x >> 8)*(1.0f/16777216.0f);
+}
+
+// two normals from two words
+inline void boxMuller(uint32_t a, uint32_t b, float & z0, float & z1)
+{
+    using namespace philoxConstants;
+    // (0, 1] so the log is finite
+    const float u = float((a >> 8)+1)*(1.0f/16777216.0f);
+    const float r = std::sqrt(-2.0f*polyLog(u));
+    // the angle is taken in [-pi, pi), a half turn only flips both signs
+    const float t = TWO_PI*(philoxFloat(b)-0.5f);
+    z0 = r*polySin(t+HALF_PI);
+    z1 = r*polySin(t);
+}
+
+#ifdef SIMD_KERNEL_X86
+
+// polyLog for 8 lanes, op for op so it rounds the same
+__attribute__((target("avx2")))
+__m256 logAVX2(__m256 x)
+{
+    using namespace logPoly;
+    __m256i bits = _mm256_castps_si256(x);
+    __m256 e = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126)));
+    bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F000000));
+    __m256 m = _mm256_castsi256_ps(bits);
+    __m256 low = _mm256_cmp_ps(m, _mm256_set1_ps(SQRT_HALF), _CMP_LT_OQ);
+    e = _mm256_blendv_ps(e, _mm256_sub_ps(e, _mm256_set1_ps(1.0f)), low);
+    __m256 f = _mm256_sub_ps(_mm256_blendv_ps(m, _mm256_add_ps(m, m), low), _mm256_set1_ps(1.0f));
+    __m256 z = _mm256_mul_ps(f, f);
+    __m256 p = _mm256_set1_ps(L0);
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(L1));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(L2));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(L3));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(L4));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(L5));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(L6));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(L7));
+    p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(L8));
+    __m256 y = _mm256_mul_ps(_mm256_mul_ps(f, z), p);
+    y = _mm256_add_ps(y, _mm256_mul_ps(e, _mm256_set1_ps(LN2_B)));
+    y = _mm256_sub_ps(y, _mm256_mul_ps(_mm256_set1_ps(0.5f), z));
+    return _mm256_add_ps(_mm256_add_ps(f, y), _mm256_mul_ps(e, _mm256_set1_ps(LN2_A)));
+}
+
+// polySin for 8 lanes without fma (unlike sinAVX2), so it rounds the same
+__attribute__((target("avx2")))
+__m256 sinNoFmaAVX2(__m256 x)
+{
+    using namespace sinPoly;
+    __m256 q = _mm256_round_ps
+    (
+        _mm256_mul_ps(x, _mm256_set1_ps(INV_PI)),
+        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC
+    );
+    __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(q, _mm256_set1_ps(PI_A)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(q, _mm256_set1_ps(PI_B)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(q, _mm256_set1_ps(PI_C)));
+    __m256 r2 = _mm256_mul_ps(r, r);
+    __m256 p = _mm256_set1_ps(S11);
+    p = _mm256_add_ps(_mm256_mul_ps(p, r2), _mm256_set1_ps(S9));
+    p = _mm256_add_ps(_mm256_mul_ps(p, r2), _mm256_set1_ps(S7));
+    p = _mm256_add_ps(_mm256_mul_ps(p, r2), _mm256_set1_ps(S5));
+    p = _mm256_add_ps(_mm256_mul_ps(p, r2), _mm256_set1_ps(S3));
+    __m256 s = _mm256_add_ps(r, _mm256_mul_ps(_mm256_mul_ps(r, r2), p));
+    __m256i sign = _mm256_slli_epi32(_mm256_cvtps_epi32(q), 31);
+    return _mm256_xor_ps(s, _mm256_castsi256_ps(sign));
+}
+
+// boxMuller for 8 pairs of words
+__attribute__((target("avx2")))
+void boxMullerAVX2(__m256i a, __m256i b, __m256 & z0, __m256 & z1)
+{
+    using namespace philoxConstants;
+    const __m256 scale = _mm256_set1_ps(1.0f/16777216.0f);
+    __m256 u = _mm256_mul_ps
+    (
+        _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_srli_epi32(a, 8), _mm256_set1_epi32(1))),
+        scale
+    );
+    __m256 r = _mm256_sqrt_ps(_mm256_mul_ps(_mm256_set1_ps(-2.0f), logAVX2(u)));
+    __m256 t = _mm256_mul_ps
+    (
+        _mm256_set1_ps(TWO_PI),
+        _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(b, 8)), scale), _mm256_set1_ps(0.5f))
+    );
+    z0 = _mm256_mul_ps(r, sinNoFmaAVX2(_mm256_add_ps(t, _mm256_set1_ps(HALF_PI))));
+    z1 = _mm256_mul_ps(r, sinNoFmaAVX2(t));
+}
+
+// high and low 32 bits of the 8 products m*c
+__attribute__((target("avx2")))
+void mulHiLoAVX2(__m256i m, __m256i c, __m256i & hi, __m256i & lo)
+{
+    __m256i even = _mm256_mul_epu32(m, c);
+    __m256i odd = _mm256_mul_epu32(m, _mm256_srli_epi64(c, 32));
+    lo = _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+    hi = _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+// 4 PHILOX_LANES normals for counters [counter, counter+PHILOX_LANES)
+__attribute__((target("avx2")))
+void philoxNormalLanesAVX2(uint64_t seed, uint32_t stream, uint64_t step, uint64_t counter, float * out)
+{
+    using namespace philoxConstants;
+    uint32_t lo[PHILOX_LANES], hi[PHILOX_LANES];
+    for (uint64_t l = 0; l < PHILOX_LANES; l++)
+    {
+        lo[l] = uint32_t(counter+l);
+        hi[l] = uint32_t((counter+l) >> 32);
+    }
+    __m256i c0 = _mm256_loadu_si256((const __m256i *)lo);
+    __m256i c1 = _mm256_loadu_si256((const __m256i *)hi);
+    __m256i c2 = _mm256_set1_epi32(int(uint32_t(step)));
+    __m256i c3 = _mm256_set1_epi32(int(philoxStreamWord(stream, step)));
+    const __m256i m0 = _mm256_set1_epi64x(M0);
+    const __m256i m1 = _mm256_set1_epi64x(M1);
+    uint32_t k0 = uint32_t(seed);
+    uint32_t k1 = uint32_t(seed >> 32);
+    for (unsigned r = 0; r < 10; r++)
+    {
+        __m256i hi0, lo0, hi1, lo1;
+        mulHiLoAVX2(m0, c0, hi0, lo0);
+        mulHiLoAVX2(m1, c2, hi1, lo1);
+        c0 = _mm256_xor_si256(_mm256_xor_si256(hi1, c1), _mm256_set1_epi32(int(k0)));
+        c1 = lo1;
+        c2 = _mm256_xor_si256(_mm256_xor_si256(hi0, c3), _mm256_set1_epi32(int(k1)));
+        c3 = lo0;
+        k0 += W0;
+        k1 += W1;
+    }
+
+    __m256 z0, z1, z2, z3;
+    boxMullerAVX2(c0, c1, z0, z1);
+    boxMullerAVX2(c2, c3, z2, z3);
+    float v[4][PHILOX_LANES];
+    _mm256_storeu_ps(v[0], z0);
+    _mm256_storeu_ps(v[1], z1);
+    _mm256_storeu_ps(v[2], z2);
+    _mm256_storeu_ps(v[3], z3);
+    for (uint64_t l = 0; l < PHILOX_LANES; l++)
+    {
+        for (unsigned w = 0; w < 4; w++) { out[4*l+w] = v[w][l]; }
+    }
+}
+
+#endif /* SIMD_KERNEL_X86 */
+
+class Philox
+{
+
+public:
+
+    typedef std::array<uint32_t, 4> Block;
+
+    Philox(uint64_t seed = 0, uint32_t stream = 0)
+    : seed(seed), stream(stream)
+    {
+        if (stream >= PHILOX_STREAMS)
+        {
+            throw std::runtime_error("Philox streams are below "+std::to_string(PHILOX_STREAMS));
+        }
+    }
+
+    uint64_t seed;
+    uint32_t stream;
+
+    Block block(uint64_t counter, uint64_t step) const
+    {
+        using namespace philoxConstants;
+        Block c = {uint32_t(counter), uint32_t(counter >> 32), uint32_t(step), philoxStreamWord(stream, step)};
+        uint32_t k0 = uint32_t(seed);
+        uint32_t k1 = uint32_t(seed >> 32);
+        for (unsigned r = 0; r < 10; r++)
+        {
+            const uint64_t p0 = uint64_t(M0)*c[0];
+            const uint64_t p1 = uint64_t(M1)*c[2];
+            c =
+            {
+                uint32_t(p1 >> 32) ^ c[1] ^ k0,
+                uint32_t(p1),
+                uint32_t(p0 >> 32) ^ c[3] ^ k1,
+                uint32_t(p0)
+            };
+            k0 += W0;
+            k1 += W1;
+        }
+        return c;
+    }
+
+    // out[i-begin] ~ U[0, 1) for indices [begin, end)
+    void uniform(uint64_t step, uint64_t begin, uint64_t end, float * out) const
+    {
+        fill(step, begin, end, out, [](const Block & b, float * v)
+        {
+            for (unsigned w = 0; w < 4; w++) { v[w] = philoxFloat(b[w]); }
+        });
+    }
+
+    // out[i-begin] ~ N(0, 1) for indices [begin, end), by Box-Muller
+    void normal(uint64_t step, uint64_t begin, uint64_t end, float * out) const
+    {
+        auto normals = [](const Block & b, float * v)
+        {
+            boxMuller(b[0], b[1], v[0], v[1]);
+            boxMuller(b[2], b[3], v[2], v[3]);
+        };
+
+        uint64_t i = begin;
+#ifdef SIMD_KERNEL_X86
+        static const bool avx2 = detectSimdLevel() != SimdLevel::NONE;
+        if (avx2)
+        {
+            // up to a block boundary, then whole batches
+            i = std::min(end, (begin+3)/4*4);
+            fill(step, begin, i, out, normals);
+            for (; i+4*PHILOX_LANES <= end; i += 4*PHILOX_LANES)
+            {
+                philoxNormalLanesAVX2(seed, stream, step, i/4, out+(i-begin));
+            }
+        }
+#endif
+        fill(step, i, end, out+(i-begin), normals);
+    }
+
+private:
+
+    // whole blocks straight into out, partial blocks at the ends via a copy
+    template <class F>
+    void fill(uint64_t step, uint64_t begin, uint64_t end, float * out, F values) const
+    {
+        float v[4];
+        uint64_t i = begin;
+        while (i < end)
+        {
+            const uint64_t counter = i/4;
+            const uint64_t first = counter*4;
+            if (first == i && i+4 <= end)
+            {
+                values(block(counter, step), out+(i-begin));
+                i += 4;
+                continue;
+            }
+            values(block(counter, step), v);
+            for (uint64_t j = i; j < std::min(first+4, end); j++) { out[j-begin] = v[j-first]; }
+            i = std::min(first+4, end);
+        }
+    }
+};
+
+#endif /* PHILOX_H */
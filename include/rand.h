@@ -11,6 +11,9 @@ public:
     float nextFloat(){ return floatU(engine); }
     float nextNormal() { return floatN(engine); }
 
+    // replaces the random_device seed, for reproducible runs
+    static void seed(unsigned s) { engine.seed(s); floatN.reset(); }
+
 private:
 
     static std::uniform_real_distribution<float> floatU;
@@ -0,0 +1,377 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <zlib.h>
+
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <stdexcept>
+
+/*
+    Trajectory files, theta fields every so many steps.
+
+        header    magic "KURATRAJ", version, n, cells, dt, every
+        frames    { step, compressed bytes, zlib data } ...
+        index     { step, offset, compressed bytes } per frame
+        footer    index offset, frames, dropped, magic "KURAINDX"
+
+    Theta is stored as 16 bit turns, theta = q 2pi/65536 (error at most
+    pi/65536 ~ 4.8e-5 rad). Each frame is delta coded along the row
+    major field then split into high and low byte planes before
+    compression, smooth (synchronised) regions become runs of zeros.
+
+    The index and footer are written on close, a file without them can
+    still be read frame by frame from the start.
+*/
+
+const char TRAJECTORY_MAGIC[8] = {'K', 'U', 'R', 'A', 'T', 'R', 'A', 'J'};
+const char TRAJECTORY_INDEX_MAGIC[8] = {'K', 'U', 'R', 'A', 'I', 'N', 'D', 'X'};
+const uint32_t TRAJECTORY_VERSION = 1;
+
+struct TrajectoryHeader
+{
+    char magic[8];
+    uint32_t version = TRAJECTORY_VERSION;
+    uint32_t cells = 0;
+    uint64_t n = 0;
+    double dt = 0.0;
+    uint64_t every = 1;
+};
+
+struct TrajectoryFrameHeader
+{
+    uint64_t step = 0;
+    uint64_t compressed = 0;
+};
+
+struct TrajectoryIndexEntry
+{
+    uint64_t step = 0;
+    uint64_t offset = 0;
+    uint64_t compressed = 0;
+};
+
+struct TrajectoryFooter
+{
+    uint64_t index = 0;
+    uint64_t frames = 0;
+    uint64_t dropped = 0;
+    char magic[8];
+};
+
+// delta code then split into byte planes, bytes holds 2 q.size()
+void encodeFrame(const std::vector<uint16_t> & q, std::vector<uint8_t> & bytes)
+{
+    const uint64_t n = q.size();
+    bytes.resize(2*n);
+    uint16_t last = 0;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        const uint16_t d = uint16_t(q[i]-last);
+        last = q[i];
+        bytes[i] = uint8_t(d >> 8);
+        bytes[n+i] = uint8_t(d);
+    }
+}
+
+void decodeFrame(const std::vector<uint8_t> & bytes, std::vector<uint16_t> & q)
+{
+    const uint64_t n = bytes.size()/2;
+    q.resize(n);
+    uint16_t last = 0;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        last = uint16_t(last+((uint16_t(bytes[i]) << 8) | bytes[n+i]));
+        q[i] = last;
+    }
+}
+
+/*
+    Records frames from the simulation thread, compresses and writes them
+    on a thread of its own.
+
+    record() quantises into one of capacity preallocated buffers and
+    hands it over, it never waits on the disk. If every buffer is still
+    queued the frame is dropped and counted instead.
+*/
+class TrajectoryRecorder
+{
+
+public:
+
+    TrajectoryRecorder
+    (
+        std::string path,
+        uint64_t n,
+        uint32_t cells,
+        double dt,
+        uint64_t every,
+        unsigned capacity = 8,
+        int level = 1
+    )
+    : path(path), level(level)
+    {
+        file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr)
+        {
+            throw std::runtime_error("Could not open trajectory "+path);
+        }
+        TrajectoryHeader h;
+        std::memcpy(h.magic, TRAJECTORY_MAGIC, sizeof(h.magic));
+        h.cells = cells;
+        h.n = n;
+        h.dt = dt;
+        h.every = every;
+        ok = std::fwrite(&h, sizeof(h), 1, file) == 1;
+        offset = sizeof(h);
+
+        for (unsigned c = 0; c < std::max(capacity, 1u); c++)
+        {
+            free.push_back({0, std::vector<uint16_t>(n)});
+        }
+        writer = std::thread(&TrajectoryRecorder::main, this);
+    }
+
+    ~TrajectoryRecorder()
+    {
+        close();
+    }
+
+    // false if the frame was dropped
+    bool record(uint64_t step, const std::vector<float> & theta)
+    {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(queueLock);
+            if (free.empty() || closing)
+            {
+                dropCount++;
+                return false;
+            }
+            frame = std::move(free.back());
+            free.pop_back();
+        }
+
+        frame.step = step;
+        const double scale = 65536.0/(2.0*3.14159265358979323846);
+        for (uint64_t i = 0; i < theta.size(); i++)
+        {
+            double t = theta[i]*scale;
+            t -= 65536.0*std::floor(t/65536.0);
+            frame.q[i] = uint16_t(uint32_t(t+0.5) & 0xFFFF);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(queueLock);
+            queue.push_back(std::move(frame));
+        }
+        queueCondition.notify_one();
+        return true;
+    }
+
+    // drain the queue, write the index and close the file
+    void close()
+    {
+        {
+            std::unique_lock<std::mutex> lock(queueLock);
+            if (closing) { return; }
+            closing = true;
+        }
+        queueCondition.notify_one();
+        writer.join();
+
+        TrajectoryFooter footer;
+        footer.index = offset;
+        footer.frames = index.size();
+        footer.dropped = dropped();
+        std::memcpy(footer.magic, TRAJECTORY_INDEX_MAGIC, sizeof(footer.magic));
+        if (index.size() > 0)
+        {
+            ok = ok && std::fwrite(index.data(), sizeof(TrajectoryIndexEntry), index.size(), file) == index.size();
+        }
+        ok = ok && std::fwrite(&footer, sizeof(footer), 1, file) == 1;
+        ok = std::fclose(file) == 0 && ok;
+        if (!ok)
+        {
+            std::cerr << "Error writing trajectory " << path << "\n";
+        }
+    }
+
+    uint64_t written()
+    {
+        std::unique_lock<std::mutex> lock(queueLock);
+        return writtenCount;
+    }
+
+    uint64_t dropped()
+    {
+        std::unique_lock<std::mutex> lock(queueLock);
+        return dropCount;
+    }
+
+private:
+
+    struct Frame
+    {
+        uint64_t step;
+        std::vector<uint16_t> q;
+    };
+
+    std::string path;
+    int level;
+    FILE * file;
+    bool ok;
+    uint64_t offset;
+    std::vector<TrajectoryIndexEntry> index;
+
+    std::mutex queueLock;
+    std::condition_variable queueCondition;
+    std::deque<Frame> queue;
+    std::vector<Frame> free;
+    bool closing = false;
+    uint64_t dropCount = 0;
+    uint64_t writtenCount = 0;
+
+    std::thread writer;
+
+    void main()
+    {
+        std::vector<uint8_t> bytes, compressed;
+        while (true)
+        {
+            Frame frame;
+            {
+                std::unique_lock<std::mutex> lock(queueLock);
+                queueCondition.wait(lock, [this] { return !queue.empty() || closing; });
+                if (queue.empty())
+                {
+                    return;
+                }
+                frame = std::move(queue.front());
+                queue.pop_front();
+            }
+
+            encodeFrame(frame.q, bytes);
+            uLongf size = compressBound(bytes.size());
+            compressed.resize(size);
+            bool frameOk = compress2(compressed.data(), &size, bytes.data(), bytes.size(), level) == Z_OK;
+
+            if (frameOk && ok)
+            {
+                TrajectoryFrameHeader h;
+                h.step = frame.step;
+                h.compressed = size;
+                ok = std::fwrite(&h, sizeof(h), 1, file) == 1 &&
+                     std::fwrite(compressed.data(), 1, size, file) == size;
+                index.push_back({frame.step, offset, uint64_t(size)});
+                offset += sizeof(h)+size;
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(queueLock);
+                if (frameOk && ok) { writtenCount++; } else { dropCount++; }
+                free.push_back(std::move(frame));
+            }
+        }
+    }
+};
+
+// random access to the frames of a closed trajectory file
+class TrajectoryReader
+{
+
+public:
+
+    TrajectoryReader(std::string path)
+    {
+        file = std::fopen(path.c_str(), "rb");
+        if (file == nullptr)
+        {
+            throw std::runtime_error("Could not open trajectory "+path);
+        }
+        if
+        (
+            std::fread(&header, sizeof(header), 1, file) != 1 ||
+            std::memcmp(header.magic, TRAJECTORY_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != TRAJECTORY_VERSION
+        )
+        {
+            std::fclose(file);
+            throw std::runtime_error(path+" is not a version "+std::to_string(TRAJECTORY_VERSION)+" trajectory");
+        }
+
+        TrajectoryFooter footer;
+        if
+        (
+            std::fseek(file, -long(sizeof(footer)), SEEK_END) != 0 ||
+            std::fread(&footer, sizeof(footer), 1, file) != 1 ||
+            std::memcmp(footer.magic, TRAJECTORY_INDEX_MAGIC, sizeof(footer.magic)) != 0
+        )
+        {
+            std::fclose(file);
+            throw std::runtime_error("Trajectory "+path+" has no index (not closed?)");
+        }
+        dropped = footer.dropped;
+        index.resize(footer.frames);
+        std::fseek(file, footer.index, SEEK_SET);
+        if (footer.frames > 0 && std::fread(index.data(), sizeof(TrajectoryIndexEntry), footer.frames, file) != footer.frames)
+        {
+            std::fclose(file);
+            throw std::runtime_error("Trajectory "+path+" index is truncated");
+        }
+    }
+
+    ~TrajectoryReader()
+    {
+        std::fclose(file);
+    }
+
+    TrajectoryHeader header;
+    std::vector<TrajectoryIndexEntry> index;
+    uint64_t dropped = 0;
+
+    uint64_t frames() const { return index.size(); }
+
+    // theta of frame f, in [0, 2pi)
+    void read(uint64_t f, std::vector<float> & theta)
+    {
+        const TrajectoryIndexEntry & e = index.at(f);
+        compressed.resize(e.compressed);
+        std::fseek(file, e.offset+sizeof(TrajectoryFrameHeader), SEEK_SET);
+        bytes.resize(2*header.n);
+        uLongf size = bytes.size();
+        if
+        (
+            std::fread(compressed.data(), 1, e.compressed, file) != e.compressed ||
+            uncompress(bytes.data(), &size, compressed.data(), e.compressed) != Z_OK ||
+            size != bytes.size()
+        )
+        {
+            throw std::runtime_error("Trajectory frame "+std::to_string(f)+" is corrupt");
+        }
+        decodeFrame(bytes, q);
+        theta.resize(header.n);
+        for (uint64_t i = 0; i < header.n; i++)
+        {
+            theta[i] = float(q[i]*(2.0*3.14159265358979323846/65536.0));
+        }
+    }
+
+private:
+
+    FILE * file;
+    std::vector<uint8_t> compressed, bytes;
+    std::vector<uint16_t> q;
+};
+
+#endif /* RECORDER_H */
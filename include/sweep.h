@@ -0,0 +1,512 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <kuramoto.h>
+#include <integrator.h>
+#include <graph.h>
+#include <philox.h>
+#include <jThread/jThread.h>
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <stdexcept>
+
+#ifndef WINDOWS
+#include <unistd.h>
+#endif
+
+// the parameters of one run of a sweep
+struct SweepRun
+{
+    uint64_t index = 0;
+    int cells = 64;
+    int shells = 4;
+    float k = 10.0;
+    float kd = 1.0;
+    float o = 0.1;
+    float eta = 0.0;
+    float kp = 1.0;
+    uint64_t seed = 0;
+    std::vector<float> coef = {1.0};
+    std::vector<float> shifts = {0.0};
+
+    // candidate pair work per step, to schedule the largest runs first
+    double cost() const
+    {
+        return double(cells)*double(cells)*double(2*shells+1)*double(2*shells+1);
+    }
+};
+
+/*
+    The runs of a sweep, from a spec of whitespace separated axes
+
+        name=v0,v1,...    listed values
+        name=lo:hi:count  count values evenly spaced over [lo, hi]
+        name=lo:hi        (samples only) uniform on [lo, hi]
+
+    for names cells, shells, k, kd, o, eta, kp, seed, coefN and shiftN
+    (harmonic N from 1, missing harmonics are 0). Axes not given keep
+    the defaults.
+
+    With samples = 0 the runs are the grid of every axis, the last axis
+    varying fastest. Otherwise there are samples runs and each draws
+    every axis, a value of a list or uniform on a range, from a hash of
+    (seed, run, axis). Either way run i is a function of the spec alone,
+    which is what lets a sweep resume.
+*/
+class SweepSpec
+{
+
+public:
+
+    SweepSpec(std::string spec, const SweepRun & defaults, uint64_t samples, uint64_t seed)
+    : defaults(defaults), samples(samples), seed(seed)
+    {
+        std::stringstream tokens(spec);
+        std::string token;
+        while (tokens >> token)
+        {
+            const uint64_t eq = token.find('=');
+            if (eq == std::string::npos || eq == 0 || eq+1 == token.size())
+            {
+                throw std::runtime_error("Sweep axis is not name=values: "+token);
+            }
+            Axis axis;
+            axis.name = token.substr(0, eq);
+            set(this->defaults, axis.name, 0.0, true);
+            const std::string values = token.substr(eq+1);
+            if (values.find(':') != std::string::npos)
+            {
+                std::vector<double> bounds = numbers(values, ':');
+                if (bounds.size() == 2 && samples > 0)
+                {
+                    axis.range = true;
+                    axis.lo = bounds[0];
+                    axis.hi = bounds[1];
+                }
+                else if (bounds.size() == 3 && bounds[2] >= 1.0)
+                {
+                    const uint64_t count = bounds[2];
+                    for (uint64_t c = 0; c < count; c++)
+                    {
+                        const double t = count > 1 ? double(c)/double(count-1) : 0.0;
+                        axis.values.push_back(bounds[0]+t*(bounds[1]-bounds[0]));
+                    }
+                }
+                else
+                {
+                    throw std::runtime_error("Sweep axis range is not lo:hi:count (or lo:hi with samples): "+token);
+                }
+            }
+            else
+            {
+                axis.values = numbers(values, ',');
+            }
+            axes.push_back(axis);
+        }
+    }
+
+    uint64_t size() const
+    {
+        if (samples > 0) { return samples; }
+        uint64_t runs = 1;
+        for (const Axis & axis : axes) { runs *= axis.values.size(); }
+        return runs;
+    }
+
+    SweepRun run(uint64_t index) const
+    {
+        SweepRun r = defaults;
+        r.index = index;
+        uint64_t rest = index;
+        for (uint64_t a = axes.size(); a-- > 0;)
+        {
+            const Axis & axis = axes[a];
+            double value;
+            if (samples > 0)
+            {
+                const uint64_t h = mix64(seed ^ mix64(index*64+a));
+                const double u = double(h >> 11)*(1.0/9007199254740992.0);
+                value = axis.range
+                    ? axis.lo+u*(axis.hi-axis.lo)
+                    : axis.values[std::min(uint64_t(u*axis.values.size()), uint64_t(axis.values.size()-1))];
+            }
+            else
+            {
+                value = axis.values[rest % axis.values.size()];
+                rest /= axis.values.size();
+            }
+            set(r, axis.name, value, false);
+        }
+        return r;
+    }
+
+private:
+
+    struct Axis
+    {
+        std::string name;
+        std::vector<double> values;
+        bool range = false;
+        double lo = 0.0, hi = 0.0;
+    };
+
+    SweepRun defaults;
+    uint64_t samples, seed;
+    std::vector<Axis> axes;
+
+    static std::vector<double> numbers(std::string list, char separator)
+    {
+        std::vector<double> v;
+        std::stringstream in(list);
+        std::string item;
+        while (std::getline(in, item, separator))
+        {
+            v.push_back(std::stod(item));
+        }
+        if (v.empty())
+        {
+            throw std::runtime_error("Sweep axis has no values: "+list);
+        }
+        return v;
+    }
+
+    // name = value on r, or with check only throw for an unknown name
+    static void set(SweepRun & r, const std::string & name, double value, bool check)
+    {
+        auto harmonic = [&](std::string prefix) -> int
+        {
+            if (name.rfind(prefix, 0) != 0 || name.size() == prefix.size()) { return 0; }
+            const int h = std::stoi(name.substr(prefix.size()));
+            if (h < 1) { throw std::runtime_error("Sweep harmonics count from 1: "+name); }
+            return h;
+        };
+
+        const int c = harmonic("coef");
+        const int s = harmonic("shift");
+        if (name == "cells") { r.cells = std::max(int(std::lround(value)), 1); }
+        else if (name == "shells") { r.shells = std::max(int(std::lround(value)), 0); }
+        else if (name == "k") { r.k = value; }
+        else if (name == "kd") { r.kd = value; }
+        else if (name == "o") { r.o = value; }
+        else if (name == "eta") { r.eta = value; }
+        else if (name == "kp") { r.kp = value; }
+        else if (name == "seed") { r.seed = uint64_t(std::llround(value)); }
+        else if (c > 0 || s > 0)
+        {
+            const uint64_t h = std::max(c, s);
+            if (r.coef.size() < h) { r.coef.resize(h, 0.0); }
+            if (r.shifts.size() < h) { r.shifts.resize(h, 0.0); }
+            if (!check) { (c > 0 ? r.coef : r.shifts)[h-1] = value; }
+        }
+        else
+        {
+            throw std::runtime_error("Unknown sweep parameter: "+name);
+        }
+    }
+};
+
+/*
+    Run every run of a spec that the results file does not already hold,
+    each a headless stored graph run (threads = 1) of steps steps, on a
+    pool of workers that take the next run as they finish one, largest
+    first.
+
+    The results file is JSON lines, a header line naming the sweep then
+    one line per finished run
+
+        {"run": i, parameters..., "steps": s, "every": e, "wall": seconds,
+         "r_final": r, "r": [r at step e, 2e, ...]}
+
+    appended, flushed and synced as each run ends, so a crash loses at
+    most the runs in flight. A later sweep with the same header skips
+    the runs already there (a torn last line is cut off first), a
+    different header is an error. A line that fails to write is cut
+    off again, so only the last line can ever be torn.
+*/
+class Sweep
+{
+
+public:
+
+    Sweep
+    (
+        const SweepSpec & spec,
+        std::string header,
+        std::string path,
+        uint64_t steps,
+        uint64_t every,
+        double dt,
+        Scheme scheme,
+        Sampler sampler,
+        KernelMode mode,
+        SimdLevel simd
+    )
+    : spec(spec), header(header), path(path), steps(steps), every(std::max(every, uint64_t(1))),
+      dt(dt), scheme(scheme), sampler(sampler), mode(mode), simd(simd)
+    {}
+
+    // runs done before this sweep started
+    uint64_t resumed() const { return skipped; }
+
+    // runs finished by this sweep
+    uint64_t finished() const { return done; }
+
+    // the seed in the header of the results at path, if there are any
+    static bool previousSeed(const std::string & path, uint64_t & seed)
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::string line;
+        if (!in || !std::getline(in, line) || in.eof()) { return false; }
+        const std::string key = "\"seed\": ";
+        const std::size_t at = line.find(key);
+        if (line.rfind("{\"sweep\": ", 0) != 0 || at == std::string::npos) { return false; }
+        try
+        {
+            seed = std::stoull(line.substr(at+key.size()));
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+        return true;
+    }
+
+    void run(unsigned workers)
+    {
+        const std::set<uint64_t> previous = resume();
+        skipped = previous.size();
+
+        out = std::fopen(path.c_str(), "ab");
+        if (out == nullptr)
+        {
+            throw std::runtime_error("Could not open sweep results "+path);
+        }
+        length = std::filesystem::file_size(path);
+        if (previous.empty() && length == 0)
+        {
+            append(header);
+        }
+
+        std::vector<SweepRun> todo;
+        for (uint64_t i = 0; i < spec.size(); i++)
+        {
+            if (previous.count(i) == 0) { todo.push_back(spec.run(i)); }
+        }
+        std::stable_sort
+        (
+            todo.begin(),
+            todo.end(),
+            [](const SweepRun & a, const SweepRun & b) { return a.cost() > b.cost(); }
+        );
+
+        {
+            // destroyed, so joined, before out is closed
+            jThread::ThreadPool pool(std::max(workers, 1u));
+            for (const SweepRun & r : todo)
+            {
+                pool.queueJob([this, r]() { execute(r); });
+            }
+            pool.wait();
+        }
+        if (out != nullptr) { std::fclose(out); }
+        out = nullptr;
+    }
+
+    // one run, the line it writes to the results without a newline
+    std::string simulate(const SweepRun & r) const
+    {
+        using namespace std::chrono;
+        high_resolution_clock::time_point start = high_resolution_clock::now();
+
+        HashedGraph graph;
+        graph.seed = r.seed;
+        graph.cells = r.cells;
+        graph.shells = r.shells;
+        graph.k = r.k;
+        graph.kp = r.kp;
+        graph.kd = r.kd;
+        graph.sampler = sampler;
+
+        const uint64_t n = graph.size();
+        Kuramoto model;
+        model.expansion_coefficients = r.coef;
+        model.shifts = r.shifts;
+        model.mode = mode;
+        model.simd = simd;
+        std::vector<int> counts;
+        buildGraph(model.K, counts, graph, nullptr, {0, n});
+
+        // as a single run of the seed, stream 0 initial conditions and 1 noise
+        std::vector<float> omega(n), theta(n), noise;
+        Philox initial(r.seed, 0);
+        initial.uniform(0, 0, n, omega.data());
+        initial.uniform(1, 0, n, theta.data());
+        for (uint64_t i = 0; i < n; i++)
+        {
+            omega[i] *= r.o;
+            theta[i] *= 2.0*3.14159;
+        }
+
+        const float D = std::sqrt(2.0*r.eta*1.0/dt);
+        const Philox noiseRng(r.seed, 1);
+        if (D > 0.0) { noise.resize(n); }
+        Integrator integrator(scheme);
+        const std::vector<uint64_t> blocks = {0, n};
+
+        std::vector<double> order;
+        for (uint64_t s = 0; s < steps; s++)
+        {
+            if (D > 0.0) { noiseRng.normal(s, 0, n, noise.data()); }
+            integrator.step(model, theta, omega, counts, noise, D, dt, nullptr, blocks);
+            if ((s+1) % every == 0) { order.push_back(orderParameter(theta)); }
+        }
+        const double final = orderParameter(theta);
+        const double wall = duration_cast<duration<double>>(high_resolution_clock::now()-start).count();
+
+        std::stringstream line;
+        line.precision(6);
+        line << "{\"run\": " << r.index
+             << ", \"cells\": " << r.cells
+             << ", \"shells\": " << r.shells
+             << ", \"k\": " << r.k
+             << ", \"kd\": " << r.kd
+             << ", \"o\": " << r.o
+             << ", \"eta\": " << r.eta
+             << ", \"kp\": " << r.kp
+             << ", \"seed\": " << r.seed
+             << ", \"coef\": " << list(r.coef)
+             << ", \"shifts\": " << list(r.shifts)
+             << ", \"steps\": " << steps
+             << ", \"every\": " << every
+             << ", \"wall\": " << wall
+             << ", \"r_final\": " << final
+             << ", \"r\": " << list(order)
+             << "}";
+        return line.str();
+    }
+
+private:
+
+    SweepSpec spec;
+    std::string header, path;
+    uint64_t steps, every;
+    double dt;
+    Scheme scheme;
+    Sampler sampler;
+    KernelMode mode;
+    SimdLevel simd;
+
+    FILE * out = nullptr;
+    // bytes of whole lines in the results
+    uint64_t length = 0;
+    std::mutex writing;
+    uint64_t skipped = 0, done = 0;
+
+    template <class T>
+    static std::string list(const std::vector<T> & v)
+    {
+        std::stringstream s;
+        s.precision(6);
+        s << "[";
+        for (uint64_t i = 0; i < v.size(); i++) { s << (i > 0 ? ", " : "") << v[i]; }
+        s << "]";
+        return s.str();
+    }
+
+    // a run that throws (or cannot be written) is reported and left for the next resume
+    void execute(const SweepRun & r)
+    {
+        try
+        {
+            const std::string line = simulate(r);
+            std::lock_guard<std::mutex> lock(writing);
+            append(line);
+            done++;
+            std::cout << "Sweep run " << r.index << " done, " << done+skipped << "/" << spec.size() << "\n";
+        }
+        catch (const std::exception & e)
+        {
+            std::lock_guard<std::mutex> lock(writing);
+            std::cout << "Sweep run " << r.index << " failed: " << e.what() << "\n";
+        }
+    }
+
+    // one whole line, on disk before returning, or none of it
+    void append(const std::string & line)
+    {
+        if (out == nullptr)
+        {
+            throw std::runtime_error("Could not write sweep results "+path);
+        }
+        bool ok = std::fwrite(line.data(), 1, line.size(), out) == line.size();
+        ok = std::fputc('\n', out) != EOF && ok;
+        ok = std::fflush(out) == 0 && ok;
+#ifndef WINDOWS
+        ok = fsync(fileno(out)) == 0 && ok;
+#endif
+        if (!ok)
+        {
+            // closed first so nothing still buffered lands after the cut
+            std::fclose(out);
+            std::error_code error;
+            std::filesystem::resize_file(path, length, error);
+            out = error ? nullptr : std::fopen(path.c_str(), "ab");
+            throw std::runtime_error("Could not write sweep results "+path);
+        }
+        length += line.size()+1;
+    }
+
+    // run indices already in the results, after cutting off a torn last line
+    std::set<uint64_t> resume()
+    {
+        std::set<uint64_t> runs;
+        std::error_code error;
+        if (!std::filesystem::exists(path, error)) { return runs; }
+
+        std::string contents;
+        {
+            std::ifstream in(path, std::ios::binary);
+            std::stringstream buffer;
+            buffer << in.rdbuf();
+            contents = buffer.str();
+        }
+        const uint64_t whole = contents.rfind('\n') == std::string::npos ? 0 : contents.rfind('\n')+1;
+        if (whole < contents.size())
+        {
+            std::filesystem::resize_file(path, whole);
+            contents.resize(whole);
+        }
+        if (contents.empty()) { return runs; }
+
+        std::stringstream lines(contents);
+        std::string line;
+        std::getline(lines, line);
+        if (line != header)
+        {
+            throw std::runtime_error("Sweep results "+path+" are from a different sweep: "+line);
+        }
+        const std::string prefix = "{\"run\": ";
+        while (std::getline(lines, line))
+        {
+            if (line.rfind(prefix, 0) == 0)
+            {
+                runs.insert(std::stoull(line.substr(prefix.size())));
+            }
+        }
+        return runs;
+    }
+};
+
+#endif /* SWEEP_H */
@@ -0,0 +1,235 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+#ifndef WINDOWS
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+/*
+    Point to point messages between the ranks of a run.
+
+    exchange sends out to rank to while it receives in from rank from,
+    so two ranks that exchange with each other at once cannot deadlock
+    on full buffers. Messages between a pair of ranks arrive in the
+    order they were sent. A rank may exchange with itself.
+*/
+class Transport
+{
+
+public:
+
+    virtual ~Transport() = default;
+
+    virtual int rank() const = 0;
+
+    virtual int size() const = 0;
+
+    virtual void exchange
+    (
+        int to, const void * out, uint64_t outBytes,
+        int from, void * in, uint64_t inBytes
+    ) = 0;
+
+    void send(int to, const void * out, uint64_t bytes) { exchange(to, out, bytes, -1, nullptr, 0); }
+
+    void recv(int from, void * in, uint64_t bytes) { exchange(-1, nullptr, 0, from, in, bytes); }
+};
+
+// a single rank, every exchange is with itself
+class LocalTransport : public Transport
+{
+
+public:
+
+    int rank() const { return 0; }
+
+    int size() const { return 1; }
+
+    void exchange
+    (
+        int to, const void * out, uint64_t outBytes,
+        int from, void * in, uint64_t inBytes
+    )
+    {
+        if (to == 0 && from == 0 && outBytes == inBytes)
+        {
+            std::memmove(in, out, inBytes);
+        }
+        else if (to >= 0 || from >= 0)
+        {
+            throw std::runtime_error("LocalTransport can only exchange with itself");
+        }
+    }
+};
+
+#ifndef WINDOWS
+
+/*
+    Ranks on one machine joined by a full mesh of Unix stream socket
+    pairs. Make one with forkRanks, exchanges poll both sockets and
+    move whatever each is ready for until both messages are through.
+*/
+class SocketTransport : public Transport
+{
+
+public:
+
+    SocketTransport(int rank, std::vector<int> peers, std::vector<pid_t> children)
+    : me(rank), peers(peers), children(children)
+    {}
+
+    ~SocketTransport()
+    {
+        for (int fd : peers)
+        {
+            if (fd >= 0) { ::close(fd); }
+        }
+        for (pid_t child : children)
+        {
+            waitpid(child, nullptr, 0);
+        }
+    }
+
+    int rank() const { return me; }
+
+    int size() const { return peers.size(); }
+
+    void exchange
+    (
+        int to, const void * out, uint64_t outBytes,
+        int from, void * in, uint64_t inBytes
+    )
+    {
+        const char * o = static_cast<const char *>(out);
+        char * i = static_cast<char *>(in);
+
+        if (to == me || from == me)
+        {
+            if (to != me || from != me || outBytes != inBytes)
+            {
+                throw std::runtime_error("A rank can only exchange with itself both ways");
+            }
+            std::memmove(i, o, inBytes);
+            return;
+        }
+
+        uint64_t sent = to >= 0 ? 0 : outBytes;
+        uint64_t received = from >= 0 ? 0 : inBytes;
+        while (sent < outBytes || received < inBytes)
+        {
+            pollfd fds[2];
+            int count = 0;
+            int sendAt = -1, recvAt = -1;
+            if (sent < outBytes)
+            {
+                fds[count] = {peers.at(to), POLLOUT, 0};
+                sendAt = count++;
+            }
+            if (received < inBytes)
+            {
+                fds[count] = {peers.at(from), POLLIN, 0};
+                recvAt = count++;
+            }
+
+            if (poll(fds, count, -1) < 0)
+            {
+                if (errno == EINTR) { continue; }
+                throw std::runtime_error("Rank "+std::to_string(me)+" poll failed");
+            }
+
+            if (sendAt >= 0 && fds[sendAt].revents != 0)
+            {
+                ssize_t s = ::send(fds[sendAt].fd, o+sent, outBytes-sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+                if (s < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                {
+                    throw std::runtime_error("Rank "+std::to_string(me)+" lost rank "+std::to_string(to));
+                }
+                if (s > 0) { sent += s; }
+            }
+
+            if (recvAt >= 0 && fds[recvAt].revents != 0)
+            {
+                ssize_t r = ::recv(fds[recvAt].fd, i+received, inBytes-received, MSG_DONTWAIT);
+                if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                {
+                    throw std::runtime_error("Rank "+std::to_string(me)+" lost rank "+std::to_string(from));
+                }
+                if (r > 0) { received += r; }
+            }
+        }
+    }
+
+private:
+
+    int me;
+    // socket to each rank, -1 for this one
+    std::vector<int> peers;
+    // waited for when rank 0 is done
+    std::vector<pid_t> children;
+};
+
+/*
+    Fork ranks-1 copies of this process and return each its transport,
+    rank 0 is the caller. Rank 0's transport waits for the others when
+    it is destroyed.
+*/
+std::unique_ptr<SocketTransport> forkRanks(int ranks)
+{
+    std::vector<std::vector<int>> mesh(ranks, std::vector<int>(ranks, -1));
+    for (int a = 0; a < ranks; a++)
+    {
+        for (int b = a+1; b < ranks; b++)
+        {
+            int pair[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+            {
+                throw std::runtime_error("Could not create a socket pair for the ranks");
+            }
+            mesh[a][b] = pair[0];
+            mesh[b][a] = pair[1];
+        }
+    }
+
+    int me = 0;
+    std::vector<pid_t> children;
+    for (int r = 1; r < ranks; r++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            throw std::runtime_error("Could not fork rank "+std::to_string(r));
+        }
+        if (pid == 0)
+        {
+            me = r;
+            children.clear();
+            break;
+        }
+        children.push_back(pid);
+    }
+
+    // keep only this rank's ends
+    for (int a = 0; a < ranks; a++)
+    {
+        for (int b = 0; b < ranks; b++)
+        {
+            if (a != me && mesh[a][b] >= 0) { ::close(mesh[a][b]); }
+        }
+    }
+    return std::make_unique<SocketTransport>(me, mesh[me], children);
+}
+
+#endif /* WINDOWS */
+
+#endif /* TRANSPORT_H */
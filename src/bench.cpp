@@ -0,0 +1,519 @@
+#include <kuramoto.h>
+#include <integrator.h>
+#include <graph.h>
+#include <implicitGraph.h>
+#include <colourMap.h>
+#include <rand.h>
+#include <philox.h>
+#include <noise.h>
+#include <domain.h>
+#include <ensemble.h>
+#include <numa.h>
+
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <algorithm>
+#include <functional>
+
+using namespace std::chrono;
+
+/*
+    Microbenchmarks of the simulation hot paths, written as JSON.
+
+    Graph sized benchmarks (graph construction with either sampler,
+    interaction with the stored and the implicit graph and for an
+    ensemble of ENSEMBLE replicas, and the full step) run over every
+    cells x shells pair, the rest over a fixed
+    batch of SAMPLES calls. The graph and the RNG are seeded so every
+    run times the same graphs and inputs. The domain decomposition runs
+    over each count of forked ranks, at the last cells and first shells.
+    Bandwidth entries read 4 byte floats, GB/s is 4/ns_per_item.
+    samplerDegree times the degrees of every row under both samplers
+    and also writes their mean and variance, with the differences in
+    standard errors (z), so a sampler change that shifts the degree
+    distribution shows up at a fixed seed. The z are only meaningful
+    while 2 shells+1 <= cells, a wider box repeats cells in BOX.
+
+    Kuramoto-bench -cells "64 128 256" -shells "4 8 16" -ranks "1 2 4" -repeats 5 -out bench.json
+*/
+
+const uint64_t SAMPLES = 1 << 20;
+// replicas of ensembleInteraction, items are replica edges
+const unsigned ENSEMBLE = 16;
+
+// the Kuramoto target's defaults, but with noise so the step draws it
+const float k = 10.0;
+const float o = 0.1;
+const float kd = 1.0;
+const float kp = 1.0;
+const float eta = 0.01;
+const double dt = 1.0/60.0;
+
+const std::vector<float> coef = {1.0, 0.5, 0.25, 0.125};
+const std::vector<float> shifts = {0.0, 0.1, 0.2, 0.3};
+
+volatile float sink = 0.0;
+
+struct Result
+{
+    std::string name;
+    int cells = 0;
+    int shells = 0;
+    unsigned harmonics = 0;
+    unsigned ranks = 1;
+    // work per timed run, candidate pairs, edges, calls or oscillators
+    uint64_t items = 0;
+    std::vector<double> times;
+    // extra named figures, written after the times
+    std::vector<std::pair<std::string, double>> stats;
+};
+
+// mean and (unbiased) variance of the row degrees of graph
+std::pair<double, double> degreeMoments(const HashedGraph & graph)
+{
+    const uint64_t n = graph.size();
+    double sum = 0.0, squares = 0.0;
+    for (uint64_t i = 0; i < n; i++)
+    {
+        const double d = graph.degree(i);
+        sum += d;
+        squares += d*d;
+    }
+    const double mean = sum/double(n);
+    return {mean, n > 1 ? (squares-double(n)*mean*mean)/double(n-1) : 0.0};
+}
+
+// wall times of repeats runs of job, after one untimed warm up
+std::vector<double> measure(const std::function<void()> & job, unsigned repeats)
+{
+    job();
+    std::vector<double> times;
+    for (unsigned r = 0; r < repeats; r++)
+    {
+        high_resolution_clock::time_point tic = high_resolution_clock::now();
+        job();
+        times.push_back(duration_cast<duration<double>>(high_resolution_clock::now()-tic).count());
+    }
+    return times;
+}
+
+void json(std::ostream & out, const std::vector<Result> & results, unsigned seed, unsigned repeats)
+{
+    out << std::setprecision(9);
+    out << "{\n"
+        << "  \"seed\": " << seed << ",\n"
+        << "  \"repeats\": " << repeats << ",\n"
+        << "  \"simd\": \"" << simdLevelName(detectSimdLevel()) << "\",\n"
+        << "  \"benchmarks\":\n"
+        << "  [\n";
+    for (uint64_t r = 0; r < results.size(); r++)
+    {
+        const Result & res = results[r];
+        std::vector<double> t = res.times;
+        std::sort(t.begin(), t.end());
+        double mean = 0.0;
+        for (double x : t) { mean += x; }
+        mean /= double(t.size());
+        const double median = t.size() % 2 == 1 ? t[t.size()/2] : 0.5*(t[t.size()/2-1]+t[t.size()/2]);
+
+        out << "    {"
+            << "\"name\": \"" << res.name << "\", "
+            << "\"cells\": " << res.cells << ", "
+            << "\"shells\": " << res.shells << ", "
+            << "\"harmonics\": " << res.harmonics << ", "
+            << "\"ranks\": " << res.ranks << ", "
+            << "\"items\": " << res.items << ", "
+            << "\"min\": " << t.front() << ", "
+            << "\"median\": " << median << ", "
+            << "\"mean\": " << mean << ", "
+            << "\"ns_per_item\": " << 1e9*median/double(std::max(res.items, uint64_t(1)));
+        for (const std::pair<std::string, double> & stat : res.stats)
+        {
+            out << ", \"" << stat.first << "\": " << stat.second;
+        }
+        out << "}" << (r+1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n"
+        << "}\n";
+}
+
+#ifndef WINDOWS
+/*
+    Times steps of DomainKuramoto over ranks forked processes, every
+    rank runs the same measure loop and rank 0's times are returned.
+    Each timed run ends in a sum over the ranks so it covers the
+    slowest.
+*/
+std::vector<double> measureRanks(const HashedGraph & graph, int ranks, unsigned steps, unsigned repeats)
+{
+    std::vector<double> times;
+    bool root = true;
+    {
+        std::unique_ptr<SocketTransport> transport = forkRanks(ranks);
+        root = transport->rank() == 0;
+
+        std::vector<int> counts;
+        DomainKuramoto domain(graph, *transport, counts, nullptr, 1);
+        domain.local.expansion_coefficients = coef;
+        domain.local.shifts = shifts;
+
+        const uint64_t n = domain.size();
+        std::vector<float> omega(n), theta(n);
+        Philox initial(graph.seed, 0);
+        initial.uniform(0, domain.begin(), domain.begin()+n, omega.data());
+        initial.uniform(1, domain.begin(), domain.begin()+n, theta.data());
+        for (uint64_t i = 0; i < n; i++)
+        {
+            omega[i] *= o;
+            theta[i] *= 2.0*3.14159;
+        }
+
+        Integrator integrator(Scheme::EULER);
+        const std::vector<uint64_t> blocks = domain.partition(1);
+        const float D = std::sqrt(2.0*eta*1.0/dt);
+        NoiseStage noiseStage(n, graph.seed, 1, 0, domain.begin());
+
+        times = measure
+        (
+            [&]()
+            {
+                for (unsigned s = 0; s < steps; s++)
+                {
+                    integrator.step(domain, theta, omega, counts, noiseStage.next(), D, dt, nullptr, blocks);
+                }
+                domain.sum(0);
+            },
+            repeats
+        );
+    }
+    // rank 0 has waited for the rest, which stop here
+    if (!root)
+    {
+        std::exit(0);
+    }
+    return times;
+}
+#endif
+
+std::vector<int> intList(std::string s)
+{
+    std::stringstream c(s);
+    std::vector<int> v;
+    int i;
+    while (c >> i) { v.push_back(i); }
+    return v;
+}
+
+int main(int argv, char ** argc)
+{
+    std::vector<int> cellSizes = {64, 128, 256};
+    std::vector<int> shellSizes = {4, 8, 16};
+    std::vector<int> rankCounts = {1, 2, 4};
+    unsigned repeats = 5;
+    unsigned seed = 1234;
+    std::string outFile = "";
+
+    std::map<std::string, std::string> args;
+    for (int i = 1; i+1 < argv; i += 2)
+    {
+        args[argc[i]] = argc[i+1];
+    }
+
+    if (args.find("-cells") != args.end()) { cellSizes = intList(args["-cells"]); }
+    if (args.find("-shells") != args.end()) { shellSizes = intList(args["-shells"]); }
+    if (args.find("-ranks") != args.end()) { rankCounts = intList(args["-ranks"]); }
+    if (args.find("-repeats") != args.end()) { repeats = std::max(std::stoi(args["-repeats"]), 1); }
+    if (args.find("-seed") != args.end()) { seed = std::stoul(args["-seed"]); }
+    if (args.find("-out") != args.end()) { outFile = args["-out"]; }
+
+    std::vector<Result> results;
+    RNG rng;
+
+    auto add = [&](std::string name, int cells, int shells, unsigned harmonics, uint64_t items, const std::function<void()> & job)
+    {
+        std::cerr << name << " cells " << cells << " shells " << shells << " harmonics " << harmonics << "\n";
+        Result res;
+        res.name = name;
+        res.cells = cells;
+        res.shells = shells;
+        res.harmonics = harmonics;
+        res.items = items;
+        res.times = measure(job, repeats);
+        results.push_back(res);
+    };
+
+    RNG::seed(seed);
+    std::vector<float> phi(SAMPLES);
+    for (uint64_t i = 0; i < SAMPLES; i++) { phi[i] = (rng.nextFloat()-0.5)*4.0*3.14159; }
+
+    for (unsigned h = 1; h <= coef.size(); h++)
+    {
+        Kuramoto model;
+        model.expansion_coefficients = std::vector<float>(coef.begin(), coef.begin()+h);
+        model.shifts = std::vector<float>(shifts.begin(), shifts.begin()+h);
+        add
+        (
+            "kernel", 0, 0, h, SAMPLES,
+            [&]()
+            {
+                float s = 0.0;
+                for (uint64_t i = 0; i < SAMPLES; i++) { s += model.kernel(phi[i]); }
+                sink = s;
+            }
+        );
+    }
+
+    add
+    (
+        "cmap", 0, 0, 0, SAMPLES,
+        [&]()
+        {
+            float s = 0.0;
+            for (uint64_t i = 0; i < SAMPLES; i++)
+            {
+                glm::vec3 c = cmap(phi[i]/(4.0*3.14159)+0.5);
+                s += c.r+c.g+c.b;
+            }
+            sink = s;
+        }
+    );
+
+    add
+    (
+        "nextNormal", 0, 0, 0, SAMPLES,
+        [&]()
+        {
+            float s = 0.0;
+            for (uint64_t i = 0; i < SAMPLES; i++) { s += rng.nextNormal(); }
+            sink = s;
+        }
+    );
+
+    Philox philox(seed, 1);
+    std::vector<float> normals(SAMPLES);
+    uint64_t step = 0;
+    add
+    (
+        "philoxNormal", 0, 0, 0, SAMPLES,
+        [&]() { philox.normal(step++, 0, SAMPLES, normals.data()); sink = normals[0]; }
+    );
+
+    for (int cells : cellSizes)
+    {
+        for (int shells : shellSizes)
+        {
+            const int n = cells*cells;
+            Kuramoto model;
+            std::vector<int> counts;
+
+            HashedGraph graph;
+            graph.seed = seed;
+            graph.cells = cells;
+            graph.shells = shells;
+            graph.k = k;
+            graph.kp = kp;
+            graph.kd = kd;
+
+            add
+            (
+                "graph", cells, shells, 0, uint64_t(n)*(2*shells+1)*(2*shells+1),
+                [&]() { buildGraph(model.K, counts, graph, nullptr, {0, uint64_t(n)}); }
+            );
+
+            HashedGraph skipGraph = graph;
+            skipGraph.sampler = Sampler::SKIP;
+            Coupling skipK;
+            std::vector<int> skipCounts;
+            add
+            (
+                "graphSkip", cells, shells, 0, uint64_t(n)*(2*shells+1)*(2*shells+1),
+                [&]() { buildGraph(skipK, skipCounts, skipGraph, nullptr, {0, uint64_t(n)}); }
+            );
+
+            add
+            (
+                "samplerDegree", cells, shells, 0, 2*uint64_t(n),
+                [&]() { sink = degreeMoments(graph).first+degreeMoments(skipGraph).first; }
+            );
+            {
+                // rows are independent, so the mean differs by sqrt((var+var)/n) by chance
+                const std::pair<double, double> box = degreeMoments(graph);
+                const std::pair<double, double> skip = degreeMoments(skipGraph);
+                const double meanError = std::sqrt((box.second+skip.second)/double(n));
+                // and each variance by about var sqrt(2/(n-1)) for near normal degrees
+                const double varError = std::sqrt(2.0/double(n-1))*std::sqrt(box.second*box.second+skip.second*skip.second);
+                results.back().stats =
+                {
+                    {"boxMean", box.first}, {"boxVar", box.second},
+                    {"skipMean", skip.first}, {"skipVar", skip.second},
+                    {"meanZ", meanError > 0.0 ? (skip.first-box.first)/meanError : 0.0},
+                    {"varZ", varError > 0.0 ? (skip.second-box.second)/varError : 0.0}
+                };
+            }
+
+            std::vector<float> omega(n), theta(n), dtheta(n, 0.0);
+            for (int i = 0; i < n; i++)
+            {
+                omega[i] = rng.nextFloat()*o;
+                theta[i] = rng.nextFloat()*2.0*3.14159;
+            }
+
+            add
+            (
+                "interaction", cells, shells, 1, model.K.edges(),
+                [&]() { model.interaction(theta, dtheta); }
+            );
+
+            std::vector<Replica> replicas(ENSEMBLE);
+            for (unsigned r = 0; r < ENSEMBLE; r++) { replicas[r].seed = seed+r; }
+            Ensemble ensemble(Coupling(model.K), counts, replicas, {1.0}, {0.0}, KernelMode::SIMD, detectSimdLevel());
+            add
+            (
+                "ensembleInteraction", cells, shells, 1, model.K.edges()*ENSEMBLE,
+                [&]() { ensemble.interaction(0, ensemble.size()); }
+            );
+
+            ImplicitKuramoto implicit;
+            implicit.graph = graph;
+            add
+            (
+                "implicitInteraction", cells, shells, 1, model.K.edges(),
+                [&]() { implicit.interaction(theta, dtheta, nullptr, {0, uint64_t(n)}); }
+            );
+
+            Integrator integrator(Scheme::EULER);
+            const std::vector<uint64_t> blocks = model.partition(1);
+            const float D = std::sqrt(2.0*eta*1.0/dt);
+
+            // as the Kuramoto target's step, noise from the stage then Euler-Maruyama
+            NoiseStage noiseStage(n, seed, 1);
+            add
+            (
+                "step", cells, shells, 1, uint64_t(n),
+                [&]() { integrator.step(model, theta, omega, counts, noiseStage.next(), D, dt, nullptr, blocks); }
+            );
+        }
+    }
+
+    /*
+        Read bandwidth between NUMA nodes, bandwidthCpuCMemM reads a
+        buffer first touched on node M with every cpu of node C, so the
+        diagonal is local and the rest remote.
+    */
+    const std::vector<std::vector<int>> nodes = numaNodes();
+    const uint64_t streamed = uint64_t(1) << 25;
+    for (uint64_t m = 0; m < nodes.size(); m++)
+    {
+        // memory only nodes cannot be first touched without libnuma
+        if (nodes[m].empty()) { continue; }
+        std::vector<float> buffer;
+        std::thread toucher
+        (
+            [&]()
+            {
+                pinCurrentThread(nodes[m][0]);
+                buffer.assign(streamed, 1.0f);
+            }
+        );
+        toucher.join();
+
+        for (uint64_t c = 0; c < nodes.size(); c++)
+        {
+            const std::vector<int> & cpus = nodes[c];
+            if (cpus.empty()) { continue; }
+            const std::vector<uint64_t> chunks = evenBlocks(streamed, cpus.size());
+            add
+            (
+                "bandwidthCpu"+std::to_string(c)+"Mem"+std::to_string(m), 0, 0, 0, streamed,
+                [&]()
+                {
+                    std::vector<std::thread> readers;
+                    std::vector<float> sums(cpus.size(), 0.0f);
+                    for (uint64_t t = 0; t < cpus.size(); t++)
+                    {
+                        readers.emplace_back
+                        (
+                            [&, t]()
+                            {
+                                pinCurrentThread(cpus[t]);
+                                // independent sums so the adds keep up with memory
+                                float s[8] = {0.0};
+                                uint64_t i = chunks[t];
+                                for (; i+8 <= chunks[t+1]; i += 8)
+                                {
+                                    for (unsigned l = 0; l < 8; l++) { s[l] += buffer[i+l]; }
+                                }
+                                for (; i < chunks[t+1]; i++) { s[0] += buffer[i]; }
+                                sums[t] = s[0]+s[1]+s[2]+s[3]+s[4]+s[5]+s[6]+s[7];
+                            }
+                        );
+                    }
+                    for (std::thread & r : readers) { r.join(); }
+                    sink = sums[0];
+                }
+            );
+        }
+    }
+
+#ifndef WINDOWS
+    /*
+        Scaling of the strip decomposition. Strong keeps the largest
+        cells and splits it over more ranks, weak grows cells with
+        sqrt(ranks) so each rank keeps about cells^2 oscillators.
+    */
+    const unsigned domainSteps = 10;
+    for (int ranks : rankCounts)
+    {
+        for (std::string scaling : {"domainStrong", "domainWeak"})
+        {
+            HashedGraph graph;
+            graph.seed = seed;
+            graph.cells = cellSizes.back();
+            graph.shells = shellSizes.front();
+            graph.k = k;
+            graph.kp = kp;
+            graph.kd = kd;
+            if (scaling == "domainWeak")
+            {
+                graph.cells = int(std::round(graph.cells*std::sqrt(double(ranks))));
+            }
+            try
+            {
+                DomainKuramoto::check(graph.cells, graph.shells, ranks);
+            }
+            catch (const std::exception & e)
+            {
+                std::cerr << e.what() << ", skipped\n";
+                continue;
+            }
+
+            std::cerr << scaling << " cells " << graph.cells << " shells " << graph.shells << " ranks " << ranks << "\n";
+            Result res;
+            res.name = scaling;
+            res.cells = graph.cells;
+            res.shells = graph.shells;
+            res.harmonics = coef.size();
+            res.ranks = ranks;
+            res.items = graph.size()*domainSteps;
+            res.times = measureRanks(graph, ranks, domainSteps, repeats);
+            results.push_back(res);
+        }
+    }
+#endif
+
+    if (outFile != "")
+    {
+        std::ofstream out(outFile);
+        json(out, results, seed, repeats);
+    }
+    else
+    {
+        json(std::cout, results, seed, repeats);
+    }
+
+    return 0;
+}
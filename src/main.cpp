@@ -55,6 +55,195 @@ int main(int argv, char ** argc)
             kp = std::stof(args["-kp"]);
         }
 
+        if (args.find("-threads") != args.end())
+        {
+            threads = std::max(std::stoi(args["-threads"]), 1);
+        }
+
+        if (args.find("-affinity") != args.end())
+        {
+            std::stringstream c(args["-affinity"]);
+            int cpu;
+            while (c >> cpu)
+            {
+                if (!cpuOnline(cpu))
+                {
+                    throw std::runtime_error("-affinity cpu "+std::to_string(cpu)+" is not online");
+                }
+                affinity.push_back(cpu);
+            }
+        }
+
+        if (args.find("-engine") != args.end())
+        {
+            engineType = args["-engine"];
+            if (engineType != "graph" && engineType != "implicit" && engineType != "meanfield" && engineType != "fft")
+            {
+                throw std::runtime_error("Unknown engine: "+engineType);
+            }
+        }
+
+        if (args.find("-stencil") != args.end())
+        {
+            stencilType = args["-stencil"];
+        }
+
+        if (args.find("-sampler") != args.end())
+        {
+            sampler = samplerFromString(args["-sampler"]);
+        }
+
+        if (args.find("-integrator") != args.end())
+        {
+            scheme = schemeFromString(args["-integrator"]);
+        }
+
+        if (args.find("-dt") != args.end())
+        {
+            dt = std::stod(args["-dt"]);
+        }
+
+        if (args.find("-phase") != args.end())
+        {
+            phaseType = args["-phase"];
+        }
+
+        if (args.find("-view") != args.end())
+        {
+            viewType = args["-view"];
+            if (viewType != "field" && viewType != "shapes")
+            {
+                throw std::runtime_error("Unknown view: "+viewType);
+            }
+        }
+
+        if (args.find("-kernel") != args.end())
+        {
+            kernelMode = kernelModeFromString(args["-kernel"]);
+        }
+
+        if (args.find("-simd") != args.end())
+        {
+            // can only lower what the cpu supports
+            simdLevel = std::min(simdLevel, simdLevelFromString(args["-simd"]));
+        }
+
+        if (args.find("-seed") != args.end())
+        {
+            seed = std::stoull(args["-seed"]);
+            seedGiven = true;
+        }
+
+        if (args.find("-headless") != args.end())
+        {
+            headless = std::stoull(args["-headless"]);
+        }
+
+        if (args.find("-ranks") != args.end())
+        {
+            ranks = std::max(std::stoi(args["-ranks"]), 1);
+        }
+
+        if (args.find("-replicas") != args.end())
+        {
+            replicas = std::max(std::stoi(args["-replicas"]), 0);
+        }
+
+        if (args.find("-replicaSeeds") != args.end())
+        {
+            std::stringstream c(args["-replicaSeeds"]);
+            uint64_t s;
+            while (c >> s)
+            {
+                replicaSeeds.push_back(s);
+            }
+        }
+
+        if (args.find("-replicaK") != args.end())
+        {
+            std::stringstream c(args["-replicaK"]);
+            float f;
+            while (c >> f)
+            {
+                replicaK.push_back(f);
+            }
+        }
+
+        if (args.find("-replicaO") != args.end())
+        {
+            std::stringstream c(args["-replicaO"]);
+            float f;
+            while (c >> f)
+            {
+                replicaO.push_back(f);
+            }
+        }
+
+        if (args.find("-replicaEta") != args.end())
+        {
+            std::stringstream c(args["-replicaEta"]);
+            float f;
+            while (c >> f)
+            {
+                replicaEta.push_back(f);
+            }
+        }
+
+        if (args.find("-sweep") != args.end())
+        {
+            sweepSpec = args["-sweep"];
+        }
+
+        if (args.find("-sweepSamples") != args.end())
+        {
+            sweepSamples = std::stoull(args["-sweepSamples"]);
+        }
+
+        if (args.find("-sweepEvery") != args.end())
+        {
+            sweepEvery = std::max(uint64_t(std::stoull(args["-sweepEvery"])), uint64_t(1));
+        }
+
+        if (args.find("-sweepOut") != args.end())
+        {
+            sweepOut = args["-sweepOut"];
+        }
+
+        if (args.find("-checkpoint") != args.end())
+        {
+            checkpointPath = args["-checkpoint"];
+        }
+
+        if (args.find("-checkpointEvery") != args.end())
+        {
+            checkpointEvery = std::stoull(args["-checkpointEvery"]);
+        }
+
+        if (args.find("-restore") != args.end())
+        {
+            restorePath = args["-restore"];
+        }
+
+        if (args.find("-graphCache") != args.end())
+        {
+            graphCachePath = args["-graphCache"];
+        }
+
+        if (args.find("-graphCacheSize") != args.end())
+        {
+            graphCacheSize = std::stoull(args["-graphCacheSize"]);
+        }
+
+        if (args.find("-record") != args.end())
+        {
+            recordPath = args["-record"];
+        }
+
+        if (args.find("-recordEvery") != args.end())
+        {
+            recordEvery = std::max(uint64_t(std::stoull(args["-recordEvery"])), uint64_t(1));
+        }
+
         if (args.find("-coefs") != args.end())
         {
             std::stringstream c(args["-coefs"]);
@@ -79,6 +268,37 @@ int main(int argv, char ** argc)
         }
     }
 
+    // the checkpoint's parameters replace any given
+    std::unique_ptr<Checkpoint> restored;
+    Coupling restoredK;
+    if (restorePath != "")
+    {
+        high_resolution_clock::time_point start = high_resolution_clock::now();
+        restored = std::make_unique<Checkpoint>();
+        readCheckpoint(restorePath, *restored, restoredK);
+        const CheckpointHeader & h = restored->header;
+        engineType = h.engine;
+        stencilType = h.stencil;
+        cells = h.cells;
+        shells = h.shells;
+        k = h.k;
+        o = h.o;
+        kd = h.kd;
+        eta = h.eta;
+        kp = h.kp;
+        dt = h.dt;
+        seed = h.seed;
+        sampler = Sampler(h.sampler);
+        scheme = Scheme(h.scheme);
+        kernelMode = KernelMode(h.kernel);
+        phaseType = h.phase;
+        coef = restored->coefficients;
+        shifts = restored->shifts;
+        std::cout << "Restored " << restorePath << " at step " << h.step << " in "
+                  << duration_cast<duration<double>>(high_resolution_clock::now()-start).count()
+                  << " s\n";
+    }
+
     while (coef.size() < shifts.size())
     {
         coef.push_back(1.0);
@@ -89,6 +309,368 @@ int main(int argv, char ** argc)
         shifts.push_back(0.0);
     }
 
+    if (ranks > 1)
+    {
+        if (headless == 0)
+        {
+            throw std::runtime_error("-ranks needs -headless");
+        }
+        return headlessRanks();
+    }
+
+    if (replicas > 0)
+    {
+        if (headless == 0)
+        {
+            throw std::runtime_error("-replicas needs -headless");
+        }
+        return headlessEnsemble();
+    }
+
+    if (sweepSpec != "")
+    {
+        if (headless == 0)
+        {
+            throw std::runtime_error("-sweep needs -headless");
+        }
+        return headlessSweep();
+    }
+
+    if (engineType != "graph" && kernelMode != KernelMode::STD)
+    {
+        // the other engines have their own sums and never read the kernel
+        throw std::runtime_error("-kernel simd and -kernel phasor need -engine graph");
+    }
+
+    int n = cells*cells;
+
+    Kuramoto model;
+    model.expansion_coefficients = coef;
+    model.shifts = shifts;
+    model.mode = kernelMode;
+    model.simd = simdLevel;
+    if (kernelMode == KernelMode::SIMD)
+    {
+        std::cout << "SIMD kernel: " << simdLevelName(simdLevel) << "\n";
+    }
+    std::vector<float> omega(n, 0.0);
+    std::vector<float> theta(n, 0.0);
+    std::vector<int> counts(n, 0);
+
+    MeanField meanField;
+    std::unique_ptr<Convolution> convolution;
+    ImplicitKuramoto implicit;
+    Engine * engine = &model;
+
+    std::unique_ptr<jThread::ThreadPool> pool;
+    if (threads > 1)
+    {
+        pool = std::make_unique<jThread::ThreadPool>(threads-1);
+    }
+
+    // seconds to build or load a stored graph, 0 without one
+    double graphTime = 0.0;
+    HashedGraph graph;
+    graph.seed = seed;
+    graph.cells = cells;
+    graph.shells = shells;
+    graph.k = k;
+    graph.kp = kp;
+    graph.kd = kd;
+    graph.sampler = sampler;
+
+    std::cout << "Seed: " << seed << "\n";
+    if (restored)
+    {
+        omega = restored->omega;
+        theta = restored->theta;
+    }
+    else
+    {
+        // stream 0 for initial conditions, 1 for noise
+        Philox initial(seed, 0);
+        initial.uniform(0, 0, n, omega.data());
+        initial.uniform(1, 0, n, theta.data());
+        for (int i = 0; i < n; i++)
+        {
+            omega[i] *= o;
+            theta[i] *= 2.0*3.14159;
+        }
+    }
+
+    if (engineType == "fft")
+    {
+        Stencil stencil = stencilFromString(stencilType, shells, k, kp, kd);
+        convolution = std::make_unique<Convolution>(cells);
+        convolution->expansion_coefficients = coef;
+        convolution->shifts = shifts;
+        convolution->setStencil(stencil);
+        engine = convolution.get();
+
+        for (int i = 0; i < n; i++)
+        {
+            counts[i] = std::round(convolution->neighbours);
+        }
+    }
+    else if (engineType == "meanfield")
+    {
+        meanField.n = n;
+        meanField.k = k;
+        meanField.expansion_coefficients = coef;
+        meanField.shifts = shifts;
+        engine = &meanField;
+
+        for (int i = 0; i < n; i++)
+        {
+            counts[i] = n;
+        }
+    }
+    else
+    {
+        if (engineType == "implicit")
+        {
+            implicit.graph = graph;
+            implicit.expansion_coefficients = coef;
+            implicit.shifts = shifts;
+            implicit.degrees(counts, pool.get(), evenBlocks(n, threads));
+            engine = &implicit;
+        }
+        else if (restored && restored->header.graph)
+        {
+            model.K = std::move(restoredK);
+            counts = restored->counts;
+        }
+        else
+        {
+            high_resolution_clock::time_point start = high_resolution_clock::now();
+            std::unique_ptr<GraphCache> cache;
+            bool hit = false;
+            if (graphCachePath != "")
+            {
+                // any failure to read the cache builds the graph instead
+                try
+                {
+                    cache = std::make_unique<GraphCache>(graphCachePath, graphCacheSize << 20);
+                    hit = cache->load(graph, model.K, counts);
+                }
+                catch (const std::exception & e)
+                {
+                    std::cout << "Graph cache not read, building the graph: " << e.what() << "\n";
+                }
+            }
+
+            if (hit)
+            {
+                graphTime = duration_cast<duration<double>>(high_resolution_clock::now()-start).count();
+                std::cout << "Graph cache hit " << cache->path(graph) << ", loaded in " << graphTime << " s\n";
+            }
+            else
+            {
+                buildGraph(model.K, counts, graph, pool.get(), evenBlocks(n, threads));
+                graphTime = duration_cast<duration<double>>(high_resolution_clock::now()-start).count();
+                if (cache)
+                {
+                    start = high_resolution_clock::now();
+                    try
+                    {
+                        cache->store(graph, model.K);
+                        std::cout << "Graph cache miss " << cache->path(graph) << ", built in " << graphTime << " s, stored in "
+                                  << duration_cast<duration<double>>(high_resolution_clock::now()-start).count() << " s\n";
+                    }
+                    catch (const std::exception & e)
+                    {
+                        // the graph is built, only the cache is lost
+                        std::cout << "Graph cache miss " << cache->path(graph) << ", built in " << graphTime
+                                  << " s, not stored: " << e.what() << "\n";
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<uint64_t> blocks = engine->partition(threads);
+
+    std::unique_ptr<FixedPhase> fixedPhase = fixedPhaseFromString(phaseType, coef, shifts);
+    if (fixedPhase)
+    {
+        if (engine != &model)
+        {
+            throw std::runtime_error("-phase "+phaseType+" needs -engine graph");
+        }
+        if (scheme != Scheme::EULER)
+        {
+            throw std::runtime_error("-phase "+phaseType+" needs -integrator euler");
+        }
+        fixedPhase->set(theta);
+    }
+
+    float D = std::sqrt(2.0*eta*1.0/dt);
+    Integrator integrator(scheme);
+
+    // steps taken, also the noise counter
+    uint64_t steps = restored ? restored->header.step : 0;
+    restored.reset();
+
+    // filled a step ahead on its own thread, and not at all without noise
+    std::unique_ptr<NoiseStage> noiseStage;
+    if (D > 0.0)
+    {
+        noiseStage = std::make_unique<NoiseStage>(n, seed, 1, steps);
+    }
+    const std::vector<float> none;
+
+    std::unique_ptr<CheckpointWriter> checkpointer;
+    if (checkpointPath != "")
+    {
+        checkpointer = std::make_unique<CheckpointWriter>(checkpointPath);
+    }
+
+    std::unique_ptr<TrajectoryRecorder> recorder;
+    if (recordPath != "")
+    {
+        recorder = std::make_unique<TrajectoryRecorder>(recordPath, n, cells, dt, recordEvery);
+    }
+    std::vector<float> recordTheta;
+
+    if (!affinity.empty())
+    {
+        bool pinned = pinCurrentThread(affinity[0]);
+        if (pool && affinity.size() > 1)
+        {
+            // worker i runs block i, the list wraps if short
+            pinned = pool->pin(std::vector<int>(affinity.begin()+1, affinity.end())) && pinned;
+        }
+        if (!pinned)
+        {
+            std::cout << "Could not pin every thread to -affinity\n";
+        }
+    }
+
+    // each block's state on the node of the thread that steps it
+    placePages(theta, pool.get(), blocks);
+    placePages(omega, pool.get(), blocks);
+    placePages(counts, pool.get(), blocks);
+    if (engine == &model)
+    {
+        std::vector<uint64_t> edgeBlocks(blocks.size());
+        for (uint64_t b = 0; b < blocks.size(); b++) { edgeBlocks[b] = model.K.offsets[blocks[b]]; }
+        placePages(model.K.offsets, pool.get(), blocks);
+        placePages(model.K.indices, pool.get(), edgeBlocks);
+        placePages(model.K.weights, pool.get(), edgeBlocks);
+    }
+
+    // snapshot now, written in the background
+    auto checkpoint = [&]()
+    {
+        Checkpoint state;
+        CheckpointHeader & h = state.header;
+        std::strncpy(h.engine, engineType.c_str(), sizeof(h.engine)-1);
+        std::strncpy(h.stencil, stencilType.c_str(), sizeof(h.stencil)-1);
+        h.cells = cells;
+        h.shells = shells;
+        h.k = k;
+        h.o = o;
+        h.kd = kd;
+        h.eta = eta;
+        h.kp = kp;
+        h.dt = dt;
+        h.seed = seed;
+        h.sampler = uint32_t(sampler);
+        h.scheme = uint32_t(scheme);
+        h.kernel = uint32_t(kernelMode);
+        std::strncpy(h.phase, phaseType.c_str(), sizeof(h.phase)-1);
+        h.step = steps;
+        state.coefficients = coef;
+        state.shifts = shifts;
+        state.theta = theta;
+        if (fixedPhase)
+        {
+            fixedPhase->get(state.theta);
+        }
+        state.omega = omega;
+        state.counts = counts;
+        if (!checkpointer->save(std::move(state), engine == &model ? &model.K : nullptr))
+        {
+            std::cout << "Checkpoint at step " << steps << " skipped, the last is still writing\n";
+        }
+    };
+
+    auto step = [&]()
+    {
+        const std::vector<float> & noise = noiseStage ? noiseStage->next() : none;
+
+        if (fixedPhase)
+        {
+            fixedPhase->step(model.K, omega, counts, noise, D, dt, pool.get(), blocks);
+        }
+        else
+        {
+            integrator.step(*engine, theta, omega, counts, noise, D, dt, pool.get(), blocks);
+        }
+        steps++;
+
+        if (checkpointer && checkpointEvery > 0 && steps % checkpointEvery == 0)
+        {
+            checkpoint();
+        }
+
+        if (recorder && steps % recordEvery == 0)
+        {
+            if (fixedPhase)
+            {
+                fixedPhase->get(recordTheta);
+                recorder->record(steps, recordTheta);
+            }
+            else
+            {
+                recorder->record(steps, theta);
+            }
+        }
+    };
+
+    // the last state always reaches the file
+    auto finalCheckpoint = [&]()
+    {
+        if (recorder)
+        {
+            recorder->close();
+            std::cout << "Recorded " << recorder->written() << " frames to " << recordPath
+                      << ", dropped " << recorder->dropped() << "\n";
+        }
+        if (checkpointer)
+        {
+            checkpointer->wait();
+            checkpoint();
+            checkpointer->wait();
+        }
+    };
+
+    if (headless > 0)
+    {
+        // no window or GL context, step as fast as possible
+        high_resolution_clock::time_point start = high_resolution_clock::now();
+        for (uint64_t s = 0; s < headless; s++)
+        {
+            step();
+        }
+        double wall = duration_cast<duration<double>>(high_resolution_clock::now()-start).count();
+
+        if (fixedPhase)
+        {
+            fixedPhase->get(theta);
+        }
+
+        const double evaluations = fixedPhase ? 1.0 : double(integrator.evaluations());
+        std::cout << "Steps: " << headless
+                  << ", wall time: " << wall << " s"
+                  << ", steps/s: " << double(headless)/wall
+                  << ", edges/s: " << double(headless)*evaluations*double(engine->edges())/wall
+                  << ", r: " << orderParameter(theta)
+                  << ", graph: " << graphTime << " s\n";
+        finalCheckpoint();
+        return 0;
+    }
+
     jGL::DesktopDisplay::Config conf;
 
     conf.VULKAN = false;
@@ -122,81 +704,72 @@ int main(int argv, char ** argc)
     std::vector<jGL::Shape> shapes;
     std::vector<jGL::Transform> trans;
     std::vector<glm::vec4> cols;
+    // drawn through rects, keyed by handle rather than string id
+    SlotPriorityStore<jGL::Shape> shapeStore;
+    std::shared_ptr<jGL::ShapeRenderer> rects;
+    std::shared_ptr<jGL::Shader> shader;
+
+    std::unique_ptr<FieldView> field;
+    // fixed point phases as radians for the field view
+    std::vector<float> viewTheta;
+    auto upload = [&]()
+    {
+        if (fixedPhase)
+        {
+            fixedPhase->get(viewTheta);
+            field->upload(viewTheta);
+        }
+        else
+        {
+            field->upload(theta);
+        }
+    };
 
-    RNG rng;
-    int n = cells*cells;
+    if (viewType == "shapes")
+    {
+        RNG rng;
 
-    std::shared_ptr<jGL::ShapeRenderer> rects = jGLInstance->createShapeRenderer
-    (
-        n
-    );
+        rects = jGLInstance->createShapeRenderer
+        (
+            n
+        );
 
-    shapes.reserve(n);
-    trans.reserve(n);
-    cols.reserve(n);
+        shapes.reserve(n);
+        trans.reserve(n);
+        cols.reserve(n);
 
-    float scale = camera.screenToWorld(float(resX)/float(cells), 0.0f).x;
+        float scale = camera.screenToWorld(float(resX)/float(cells), 0.0f).x;
 
-    for (unsigned i = 0; i < n; i++)
-    {
-        trans.push_back(jGL::Transform((i%cells)/float(cells)+scale/2.0f, (std::floor(i/float(cells)))/float(cells)+scale/2.0f, 0.0, scale));
-        cols.push_back(glm::vec4(rng.nextFloat(), rng.nextFloat(), rng.nextFloat(), 1.0));
-        shapes.push_back
+        for (unsigned i = 0; i < n; i++)
+        {
+            trans.push_back(jGL::Transform((i%cells)/float(cells)+scale/2.0f, (std::floor(i/float(cells)))/float(cells)+scale/2.0f, 0.0, scale));
+            cols.push_back(glm::vec4(rng.nextFloat(), rng.nextFloat(), rng.nextFloat(), 1.0));
+            shapes.push_back
+            (
+                {
+                    &trans[i],
+                    &cols[i]
+                }
+            );
+
+            shapeStore.add(shapes[i]);
+        }
+
+        shader = std::make_shared<jGL::GL::glShader>
         (
-            {
-                &trans[i],
-                &cols[i]
-            }
+            jGL::GL::glShapeRenderer::shapeVertexShader,
+            jGL::GL::glShapeRenderer::rectangleFragmentShader
         );
 
-        rects->add(shapes[i], std::to_string(i));
+        shader->use();
     }
-
-    Kuramoto model;
-    model.expansion_coefficients = coef;
-    model.shifts = shifts;
-    model.K.resize(n);
-    std::vector<float> omega(n, 0.0);
-    std::vector<float> theta(n, 0.0);
-    std::vector<float> dtheta(n, 0.0);
-    std::vector<int> counts(n, 0);
-    float dcrit2 = 0.05*0.05;
-    float l = 1.0;
-
-    for (int i = 0; i < n; i++)
+    else
     {
-        omega[i] = rng.nextFloat()*o;
-        theta[i] = rng.nextFloat()*2.0*3.14159;
-
-        auto s = shell(i%cells, std::floor(i/float(cells)), shells, cells);
-        for (auto & ij : s)
-        {
-            int rx = i%cells-ij.first; int ry = std::floor(i/float(cells))-ij.second;
-            if (rx < 0.5*cells) { rx += cells; }
-            if (rx >= 0.5*cells) { rx -= cells; }
-            if (ry < 0.5*cells) { ry += cells; }
-            if (ry >= 0.5*cells) { ry -= cells; }
-            float d = float(rx*rx+ry*ry);
-            if (rng.nextFloat() < kp*(1/(kd*d)))
-            {
-                auto n = ij.first*cells + ij.second;
-                model.K[i].push_back({n, k*rng.nextFloat()});
-                counts[i] += 1;
-            }
-        }
-        counts[i] += 1;
+        field = std::make_unique<FieldView>(cells);
+        upload();
     }
-    std::shared_ptr<jGL::Shader> shader = std::make_shared<jGL::GL::glShader>
-    (
-        jGL::GL::glShapeRenderer::shapeVertexShader,
-        jGL::GL::glShapeRenderer::rectangleFragmentShader
-    );
-
-    shader->use();
 
     double delta = 0.0;
-    double dt = 1.0/60.0;
-    float D = std::sqrt(2.0*eta*1.0/dt);
     jGL::ShapeRenderer::UpdateInfo uinfo;
 
     while (display.isOpen())
@@ -212,6 +785,25 @@ int main(int argv, char ** argc)
             camera.incrementZoom(1.0f);
         }
 
+        // pan a tenth of the view at this zoom
+        const float pan = 0.1f/camera.getZoomLevel();
+        if (display.keyHasEvent(GLFW_KEY_A, jGL::EventType::PRESS))
+        {
+            camera.move(-pan, 0.0f);
+        }
+        if (display.keyHasEvent(GLFW_KEY_D, jGL::EventType::PRESS))
+        {
+            camera.move(pan, 0.0f);
+        }
+        if (display.keyHasEvent(GLFW_KEY_S, jGL::EventType::PRESS))
+        {
+            camera.move(0.0f, -pan);
+        }
+        if (display.keyHasEvent(GLFW_KEY_W, jGL::EventType::PRESS))
+        {
+            camera.move(0.0f, pan);
+        }
+
         if (display.keyHasEvent(GLFW_KEY_SPACE, jGL::EventType::PRESS))
         {
             paused = !paused;
@@ -223,26 +815,43 @@ int main(int argv, char ** argc)
 
             if (!paused)
             {
-                model.interaction(theta, dtheta);
-                for (int i = 0; i < n; i++)
+                step();
+
+                if (field)
                 {
-                    auto & col = cols[i];
-                    theta[i] += dt * (omega[i] + rng.nextNormal()*D + (1.0/float(counts[i]))*dtheta[i]);
-                    theta[i] = fmod(theta[i], 2.0*3.14159);
-                    if (theta[i] < 0)
-                    {
-                        theta[i] += 2.0*3.14159;
-                    }
-                    glm::vec3 newColour = cmap(fmod(theta[i], 2.0*3.14159)/(2.0*3.14159));
-                    col.r = newColour.r;
-                    col.g = newColour.g;
-                    col.b = newColour.b;
-                    dtheta[i] = 0.0;
+                    upload();
+                }
+                else
+                {
+                    parallelFor
+                    (
+                        pool.get(),
+                        blocks,
+                        [&](uint64_t begin, uint64_t end)
+                        {
+                            for (uint64_t i = begin; i < end; i++)
+                            {
+                                auto & col = cols[i];
+                                float t = fixedPhase ? fixedPhase->turns(i) : fmod(theta[i], 2.0*3.14159)/(2.0*3.14159);
+                                glm::vec3 newColour = cmap(t);
+                                col.r = newColour.r;
+                                col.g = newColour.g;
+                                col.b = newColour.b;
+                            }
+                        }
+                    );
                 }
             }
 
-            rects->draw(shader, uinfo);
-            rects->setProjection(camera.getVP());
+            if (field)
+            {
+                field->draw(camera.getVP());
+            }
+            else
+            {
+                rects->draw(shader, shapeStore, uinfo);
+                rects->setProjection(camera.getVP());
+            }
 
             delta = 0.0;
             for (int n = 0; n < 60; n++)
@@ -298,5 +907,7 @@ int main(int argv, char ** argc)
 
     jGLInstance->finish();
 
+    finalCheckpoint();
+
     return 0;
 }
\ No newline at end of file
@@ -65,6 +65,8 @@ int main(int argv, char ** argc)
     RNG rng;
     int n = cells*cells;
 
+    // keyed by handle rather than string id
+    SlotPriorityStore<jGL::Shape> shapeStore(n);
     std::shared_ptr<jGL::ShapeRenderer> rects = jGLInstance->createShapeRenderer
     (
         n
@@ -88,7 +90,7 @@ int main(int argv, char ** argc)
             }
         );
 
-        rects->add(shapes[i], std::to_string(i));
+        shapeStore.add(shapes[i]);
     }
 
     Kuramoto model;